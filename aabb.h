@@ -3,6 +3,8 @@
 #define AABB_H
 
 #include "ray.h"
+#include <float.h>
+#include <algorithm>
 
 class aabb
 {
@@ -12,6 +14,13 @@ public:
     
     vec3 min() const { return _min;}
     vec3 max() const { return _max;}
+    vec3 centroid() const { return 0.5 * (_min + _max);}
+
+    float area() const
+    {
+        vec3 d = _max - _min;
+        return 2 * (d.x() * d.y() + d.y() * d.z() + d.z() * d.x());
+    }
 
     bool hit(const ray& r, float tmin, float tmax) const
     {
@@ -31,15 +40,24 @@ public:
     vec3 _min, _max;
 };
 
-inline aabb surrounding_box(aabb box0, aabb box1)
+// std::min and max rather than fmin and fmax: bounds hold no NaNs, and
+// these compile to single instructions where fmin is a library call. the
+// bvh builds call this for every primitive on every level.
+inline aabb surrounding_box(const aabb& box0, const aabb& box1)
 {
-    vec3 small(fmin(box0.min().x(), box1.min().x()),    
-               fmin(box0.min().y(), box1.min().y()),
-               fmin(box0.min().z(), box1.min().z()));
-    vec3 big  (fmax(box0.max().x(), box1.max().x()),    
-               fmax(box0.max().y(), box1.max().y()),
-               fmax(box0.max().z(), box1.max().z()));
+    vec3 small(std::min(box0._min.x(), box1._min.x()),
+               std::min(box0._min.y(), box1._min.y()),
+               std::min(box0._min.z(), box1._min.z()));
+    vec3 big  (std::max(box0._max.x(), box1._max.x()),
+               std::max(box0._max.y(), box1._max.y()),
+               std::max(box0._max.z(), box1._max.z()));
     return aabb(small, big);
 }
 
+// identity of surrounding_box, for growing a box point by point
+inline aabb empty_box()
+{
+    return aabb(vec3(FLT_MAX), vec3(-FLT_MAX));
+}
+
 #endif
\ No newline at end of file
@@ -0,0 +1,70 @@
+// acceleration structure selection
+#ifndef ACCEL_H
+#define ACCEL_H
+
+#include "bvh.h"
+#include "linear_bvh.h"
+#include "wide_bvh.h"
+#include "motion_bvh.h"
+#include <chrono>
+#include <string>
+
+enum accel_type
+{
+    ACCEL_BVH_NODE,   // pointer based binary tree
+    ACCEL_LINEAR_BVH, // flattened binary tree
+    ACCEL_BVH4,       // 4 children per node, sse box tests
+    ACCEL_BVH8,       // 8 children per node, avx box tests
+    ACCEL_MOTION_BVH  // flattened binary tree, bounds interpolated to the ray time
+};
+
+const char* accel_names[] = {"node", "linear", "bvh4", "bvh8", "motion"};
+
+accel_type accel = ACCEL_LINEAR_BVH;
+
+double bvh_build_seconds = 0; // spent in make_bvh since the scene started building
+
+inline bool parse_accel(const std::string& name)
+{
+    for(int i = 0; i <= ACCEL_MOTION_BVH; ++i)
+        if(name == accel_names[i])
+        {
+            accel = accel_type(i);
+            return true;
+        }
+    return false;
+}
+
+// counts the node and primitive arrays of a flattened bvh in the scene's memory report
+template<class B>
+inline hitable* flat_bvh(B* b)
+{
+    arena_add_external(ARENA_ACCEL, b->nodes.capacity() * sizeof(b->nodes[0]) + b->prims.capacity() * sizeof(hitable*));
+    return b;
+}
+
+inline hitable* make_accel(hitable** l, int n, float time0, float time1)
+{
+    switch(accel)
+    {
+    case ACCEL_BVH_NODE: return make<bvh_node>(l, n, time0, time1);
+    case ACCEL_BVH4:     return flat_bvh(make<wide_bvh<4>>(l, n, time0, time1));
+    case ACCEL_BVH8:     return flat_bvh(make<wide_bvh<8>>(l, n, time0, time1));
+    case ACCEL_MOTION_BVH: return flat_bvh(make<motion_bvh>(l, n, time0, time1));
+    default:             return flat_bvh(make<linear_bvh>(l, n, time0, time1));
+    }
+}
+
+// what the scene functions build their hierarchies with
+inline hitable* make_bvh(hitable** l, int n, float time0, float time1)
+{
+    auto start = std::chrono::steady_clock::now();
+    hitable* h = make_accel(l, n, time0, time1);
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bvh_build_seconds += elapsed.count();
+    if(bvh_report)
+        std::cerr << "bvh: " << n << " primitives built in " << elapsed.count() * 1e3 << "ms\n";
+    return h;
+}
+
+#endif
@@ -0,0 +1,123 @@
+// 3x4 affine transforms for instances
+#ifndef AFFINE_H
+#define AFFINE_H
+
+#include "vec3.h"
+#include "aabb.h"
+#include <math.h>
+#include <float.h>
+
+// rows of a 3x3 linear part followed by a translation column
+class affine
+{
+public:
+    affine()
+    {
+        for(int i = 0; i < 3; ++i)
+            for(int j = 0; j < 4; ++j)
+                m[i][j] = i == j ? 1 : 0;
+    }
+
+    static affine translation(const vec3& d)
+    {
+        affine a;
+        for(int i = 0; i < 3; ++i) a.m[i][3] = d[i];
+        return a;
+    }
+    static affine scaling(const vec3& s)
+    {
+        affine a;
+        for(int i = 0; i < 3; ++i) a.m[i][i] = s[i];
+        return a;
+    }
+    // right handed rotation by angle degrees about axis
+    static affine rotation(const vec3& axis, float angle)
+    {
+        vec3 u = unit_vector(axis);
+        float radians = (M_PI / 180.0) * angle;
+        float c = cos(radians), s = sin(radians), k = 1 - c;
+        affine a;
+        a.m[0][0] = c + u[0] * u[0] * k;        a.m[0][1] = u[0] * u[1] * k - u[2] * s; a.m[0][2] = u[0] * u[2] * k + u[1] * s;
+        a.m[1][0] = u[1] * u[0] * k + u[2] * s; a.m[1][1] = c + u[1] * u[1] * k;        a.m[1][2] = u[1] * u[2] * k - u[0] * s;
+        a.m[2][0] = u[2] * u[0] * k - u[1] * s; a.m[2][1] = u[2] * u[1] * k + u[0] * s; a.m[2][2] = c + u[2] * u[2] * k;
+        return a;
+    }
+
+    vec3 point(const vec3& p) const
+    {
+        return vec3(m[0][0] * p[0] + m[0][1] * p[1] + m[0][2] * p[2] + m[0][3],
+                    m[1][0] * p[0] + m[1][1] * p[1] + m[1][2] * p[2] + m[1][3],
+                    m[2][0] * p[0] + m[2][1] * p[1] + m[2][2] * p[2] + m[2][3]);
+    }
+    vec3 vector(const vec3& v) const
+    {
+        return vec3(m[0][0] * v[0] + m[0][1] * v[1] + m[0][2] * v[2],
+                    m[1][0] * v[0] + m[1][1] * v[1] + m[1][2] * v[2],
+                    m[2][0] * v[0] + m[2][1] * v[1] + m[2][2] * v[2]);
+    }
+    // the transpose of the linear part, applied to the normals of the space
+    // this is the inverse of
+    vec3 transposed_vector(const vec3& v) const
+    {
+        return vec3(m[0][0] * v[0] + m[1][0] * v[1] + m[2][0] * v[2],
+                    m[0][1] * v[0] + m[1][1] * v[1] + m[2][1] * v[2],
+                    m[0][2] * v[0] + m[1][2] * v[1] + m[2][2] * v[2]);
+    }
+
+    affine inverse() const
+    {
+        // adjugate over determinant for the linear part
+        float c00 = m[1][1] * m[2][2] - m[1][2] * m[2][1];
+        float c01 = m[1][2] * m[2][0] - m[1][0] * m[2][2];
+        float c02 = m[1][0] * m[2][1] - m[1][1] * m[2][0];
+        float inv_det = 1.0f / (m[0][0] * c00 + m[0][1] * c01 + m[0][2] * c02);
+        affine a;
+        a.m[0][0] = c00 * inv_det;
+        a.m[0][1] = (m[0][2] * m[2][1] - m[0][1] * m[2][2]) * inv_det;
+        a.m[0][2] = (m[0][1] * m[1][2] - m[0][2] * m[1][1]) * inv_det;
+        a.m[1][0] = c01 * inv_det;
+        a.m[1][1] = (m[0][0] * m[2][2] - m[0][2] * m[2][0]) * inv_det;
+        a.m[1][2] = (m[0][2] * m[1][0] - m[0][0] * m[1][2]) * inv_det;
+        a.m[2][0] = c02 * inv_det;
+        a.m[2][1] = (m[0][1] * m[2][0] - m[0][0] * m[2][1]) * inv_det;
+        a.m[2][2] = (m[0][0] * m[1][1] - m[0][1] * m[1][0]) * inv_det;
+        vec3 t = a.vector(vec3(m[0][3], m[1][3], m[2][3]));
+        for(int i = 0; i < 3; ++i) a.m[i][3] = -t[i];
+        return a;
+    }
+
+    // box around the eight transformed corners of b
+    aabb transform_box(const aabb& b) const
+    {
+        vec3 lo(FLT_MAX), hi(-FLT_MAX);
+        for(int c = 0; c < 8; ++c)
+        {
+            vec3 p = point(vec3(c & 1 ? b.max().x() : b.min().x(),
+                                c & 2 ? b.max().y() : b.min().y(),
+                                c & 4 ? b.max().z() : b.min().z()));
+            for(int i = 0; i < 3; ++i)
+            {
+                lo[i] = fmin(lo[i], p[i]);
+                hi[i] = fmax(hi[i], p[i]);
+            }
+        }
+        return aabb(lo, hi);
+    }
+
+    float m[3][4];
+};
+
+// a * b applies b first
+inline affine operator*(const affine& a, const affine& b)
+{
+    affine r;
+    for(int i = 0; i < 3; ++i)
+    {
+        for(int j = 0; j < 4; ++j)
+            r.m[i][j] = a.m[i][0] * b.m[0][j] + a.m[i][1] * b.m[1][j] + a.m[i][2] * b.m[2][j];
+        r.m[i][3] += a.m[i][3];
+    }
+    return r;
+}
+
+#endif
@@ -0,0 +1,191 @@
+// scene memory: objects of a scene packed into large blocks and freed together
+#ifndef ARENA_H
+#define ARENA_H
+
+#include <stdint.h>
+#include <stdlib.h>
+#include <iostream>
+#include <new>
+#include <type_traits>
+#include <utility>
+#include <vector>
+
+class hitable;
+class material;
+class texture;
+
+enum arena_category
+{
+    ARENA_PRIMITIVES, // shapes, instances, lists
+    ARENA_ACCEL,      // bvh nodes
+    ARENA_MATERIALS,
+    ARENA_TEXTURES,
+    ARENA_ARRAYS,     // hitable lists and other plain arrays
+    ARENA_OTHER,
+    ARENA_CATEGORIES
+};
+
+const char* arena_category_names[] = {"primitives", "accel", "materials", "textures", "arrays", "other"};
+
+// what make<T>() counts T as. the bvh types specialize it in their headers.
+template<class T>
+struct arena_category_of
+{
+    static const arena_category value =
+        std::is_base_of<material, T>::value ? ARENA_MATERIALS :
+        std::is_base_of<texture, T>::value ? ARENA_TEXTURES :
+        std::is_base_of<hitable, T>::value ? ARENA_PRIMITIVES : ARENA_OTHER;
+};
+
+// bump allocation from 64KB blocks, so objects made one after the other sit
+// next to each other. reset() frees everything at once: objects with a trivial
+// destructor cost nothing, the others (owning vectors) are destroyed in
+// reverse order first.
+class scene_arena
+{
+public:
+    scene_arena() = default;
+    scene_arena(const scene_arena&) = delete;
+    scene_arena& operator=(const scene_arena&) = delete;
+    ~scene_arena() { reset(); }
+
+    void* allocate(size_t bytes, size_t align, arena_category c)
+    {
+        used[c] += bytes;
+        if(bytes > block_size / 4)
+        {
+            // large arrays get a block of their own, leaving the current one open
+            block b = {(char*)aligned_alloc_bytes(bytes, align), bytes};
+            bool open = !blocks.empty();
+            blocks.insert(blocks.end() - (open ? 1 : 0), b);
+            if(!open) head = bytes; // it is the last block now, and full
+            reserved += bytes;
+            return b.data;
+        }
+        size_t p = (head + align - 1) & ~(align - 1);
+        if(blocks.empty() || p + bytes > blocks.back().size)
+        {
+            blocks.push_back({(char*)aligned_alloc_bytes(block_size, 64), block_size});
+            reserved += block_size;
+            p = 0;
+        }
+        head = p + bytes;
+        return blocks.back().data + p;
+    }
+
+    template<class T, class... A>
+    T* make(A&&... args)
+    {
+        void* p = allocate(sizeof(T), alignof(T), arena_category_of<T>::value);
+        T* t = new(p) T(std::forward<A>(args)...);
+        if(!std::is_trivially_destructible<T>::value)
+            cleanups.push_back({t, [](void* q) { static_cast<T*>(q)->~T(); }});
+        return t;
+    }
+    // n value initialized elements
+    template<class T>
+    T* make_array(size_t n, arena_category c = ARENA_ARRAYS)
+    {
+        static_assert(std::is_trivially_destructible<T>::value, "arena arrays are never destroyed");
+        T* a = static_cast<T*>(allocate(sizeof(T) * n, alignof(T), c));
+        for(size_t i = 0; i < n; ++i) new(a + i) T();
+        return a;
+    }
+    // p is freed with deleter on reset, for buffers made elsewhere (decoded images)
+    void own(void* p, void (*deleter)(void*))
+    {
+        cleanups.push_back({p, deleter});
+    }
+    // memory that arena objects hold outside the blocks (their vectors), for the report
+    void add_external(arena_category c, size_t bytes) { external[c] += bytes; }
+
+    void reset()
+    {
+        for(size_t i = cleanups.size(); i-- > 0;)
+            cleanups[i].destroy(cleanups[i].p);
+        cleanups.clear();
+        for(block& b : blocks) free(b.data);
+        blocks.clear();
+        head = 0;
+        reserved = 0;
+        for(int c = 0; c < ARENA_CATEGORIES; ++c) used[c] = external[c] = 0;
+    }
+
+    size_t bytes(arena_category c) const { return used[c] + external[c]; }
+
+    void report(std::ostream& os) const
+    {
+        size_t in_blocks = 0, outside = 0;
+        os << "scene memory:";
+        for(int c = 0; c < ARENA_CATEGORIES; ++c)
+        {
+            os << " " << arena_category_names[c] << " " << bytes(arena_category(c)) / 1024.0 << "KB,";
+            in_blocks += used[c];
+            outside += external[c];
+        }
+        os << " " << in_blocks / 1024.0 << "KB in " << blocks.size() << " blocks (" << reserved / 1024.0
+           << "KB reserved), " << outside / 1024.0 << "KB in vectors, " << cleanups.size() << " destructors\n";
+    }
+
+private:
+    struct block
+    {
+        char* data;
+        size_t size;
+    };
+    struct cleanup
+    {
+        void* p;
+        void (*destroy)(void*);
+    };
+
+    static void* aligned_alloc_bytes(size_t bytes, size_t align)
+    {
+        align = align < sizeof(void*) ? sizeof(void*) : align;
+        void* p = nullptr;
+        if(posix_memalign(&p, align, bytes) != 0) throw std::bad_alloc();
+        return p;
+    }
+
+    static const size_t block_size = size_t(1) << 16;
+    std::vector<block> blocks; // the last one is being filled
+    size_t head = 0;           // first free byte of the last block
+    size_t reserved = 0;
+    size_t used[ARENA_CATEGORIES] = {0};     // in the blocks
+    size_t external[ARENA_CATEGORIES] = {0}; // see add_external
+    std::vector<cleanup> cleanups;
+};
+
+// the arena of the scene being built. make() falls back to the heap when
+// there is none, for objects that live as long as the program.
+inline scene_arena*& active_arena()
+{
+    static scene_arena* a = nullptr;
+    return a;
+}
+
+template<class T, class... A>
+T* make(A&&... args)
+{
+    if(scene_arena* a = active_arena()) return a->make<T>(std::forward<A>(args)...);
+    return new T(std::forward<A>(args)...);
+}
+
+template<class T>
+T* make_array(size_t n, arena_category c = ARENA_ARRAYS)
+{
+    if(scene_arena* a = active_arena()) return a->make_array<T>(n, c);
+    return new T[n]();
+}
+
+inline void arena_own(void* p, void (*deleter)(void*))
+{
+    if(scene_arena* a = active_arena()) a->own(p, deleter);
+}
+
+inline void arena_add_external(arena_category c, size_t bytes)
+{
+    if(scene_arena* a = active_arena()) a->add_external(c, bytes);
+}
+
+#endif
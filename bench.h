@@ -0,0 +1,108 @@
+// micro benchmarks
+#ifndef BENCH_H
+#define BENCH_H
+
+#include "hitable.h"
+#include "camera.h"
+#include "accel.h"
+#include <chrono>
+#include <iostream>
+#include <float.h>
+
+struct bench_result
+{
+    double seconds = 0;
+    uint64_t rays = 0;
+    uint64_t nodes = 0;
+};
+
+inline void print_bench(std::ostream& os, const char* name, const bench_result& b)
+{
+    os << name << ": " << b.rays / b.seconds * 1e-6 << " Mrays/s, "
+       << double(b.nodes) / b.rays << " nodes/ray\n";
+}
+
+// single threaded closest hit queries: one camera ray per pixel, then one
+// diffuse bounce from every camera hit (incoherent rays). shadow runs the
+// bounce rays again as occluded() queries.
+inline void bench_traversal(const camera& cam, hitable* world, int nx, int ny, bench_result& primary, bench_result& bounce,
+                            bench_result& shadow)
+{
+    sampler smp;
+    std::vector<ray> secondary;
+    secondary.reserve(size_t(nx) * ny);
+    hit_record rec;
+
+    thread_counters() = traversal_counters();
+    auto start = std::chrono::steady_clock::now();
+    for(int j = 0; j < ny; ++j)
+        for(int i = 0; i < nx; ++i)
+        {
+            smp.start(uint64_t(j) * nx + i, 0);
+            ray r = cam.get_ray((i + 0.5f) / nx, (j + 0.5f) / ny, smp);
+            if(world->hit(r, 0.001, FLT_MAX, rec))
+            {
+                finish_hit(r, rec);
+                secondary.push_back(ray(rec.p, rec.normal + random_in_unit_sphere(smp.rng), r.time()));
+            }
+        }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    primary.seconds = elapsed.count();
+    primary.rays = uint64_t(nx) * ny;
+    primary.nodes = thread_counters().nodes;
+
+    thread_counters() = traversal_counters();
+    start = std::chrono::steady_clock::now();
+    for(const ray& r : secondary)
+        world->hit(r, 0.001, FLT_MAX, rec);
+    elapsed = std::chrono::steady_clock::now() - start;
+    bounce.seconds = elapsed.count();
+    bounce.rays = secondary.size();
+    bounce.nodes = thread_counters().nodes;
+
+    thread_counters() = traversal_counters();
+    start = std::chrono::steady_clock::now();
+    for(const ray& r : secondary)
+        world->occluded(r, 0.001, FLT_MAX);
+    elapsed = std::chrono::steady_clock::now() - start;
+    shadow.seconds = elapsed.count();
+    shadow.rays = secondary.size();
+    shadow.nodes = thread_counters().nodes;
+}
+
+// the camera pass of bench_traversal with (simd_width / 2) x 2 pixel packets
+inline bench_result bench_packets(const camera& cam, hitable* world, int nx, int ny)
+{
+    const int bw = simd_width / 2, bh = 2;
+    sampler smp[simd_width];
+    float u[simd_width], v[simd_width];
+    hit_record recs[simd_width];
+    ray_packet p;
+
+    thread_counters() = traversal_counters();
+    auto start = std::chrono::steady_clock::now();
+    for(int y = 0; y < ny; y += bh)
+        for(int x = 0; x < nx; x += bw)
+        {
+            int mask = 0;
+            for(int k = 0; k < simd_width; ++k)
+            {
+                int i = x + k % bw, j = y + k / bw;
+                if(i >= nx || j >= ny) continue;
+                mask |= 1 << k;
+                smp[k].start(uint64_t(j) * nx + i, 0);
+                u[k] = (i + 0.5f) / nx;
+                v[k] = (j + 0.5f) / ny;
+            }
+            cam.get_packet(u, v, smp, mask, p);
+            world->hit_packet(p, mask, 0.001, recs);
+        }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    bench_result b;
+    b.seconds = elapsed.count();
+    b.rays = uint64_t(nx) * ny;
+    b.nodes = thread_counters().nodes;
+    return b;
+}
+
+#endif
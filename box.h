@@ -3,29 +3,101 @@
 
 #include "ray.h"
 #include "material.h"
-#include "rectangle.h"
-#include "hitable_list.h"
+#include "hitable.h"
 #include "aabb.h"
 
+// axis aligned box intersected with one slab test. a ray entering the box
+// hits its entry face, a ray starting inside hits the exit face; normals
+// point outward like the six rects it replaces, uvs span each face.
 class box : public hitable
 {
 public:
     box() = default;
-    box(const vec3& p0, const vec3& p1, material* ptr)
+    box(const vec3& p0, const vec3& p1, material* ptr) : pmin(p0), pmax(p1), mp(ptr) {}
+
+    // entry and exit distances, false when the ray misses the slabs
+    bool slabs(const ray& r, float& t_near, float& t_far) const
+    {
+        float t_in = -FLT_MAX, t_out = FLT_MAX;
+        for(int a = 0; a < 3; ++a)
+        {
+            float inv_d = 1.0f / r.direction()[a];
+            float t0 = (pmin[a] - r.origin()[a]) * inv_d;
+            float t1 = (pmax[a] - r.origin()[a]) * inv_d;
+            // min and max instead of a swap on the sign, which rays take at random
+            t_in = std::max(t_in, std::min(t0, t1));
+            t_out = std::min(t_out, std::max(t0, t1));
+        }
+        t_near = t_in;
+        t_far = t_out;
+        return t_in <= t_out;
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return slabs(r, t_enter, t_exit);
+    }
+    virtual bool hit(const ray& r, float t0, float t1, hit_record& rec) const
+    {
+        float t_near, t_far;
+        if(!slabs(r, t_near, t_far)) return false;
+        float t = t_near > t0 ? t_near : t_far;
+        if(t <= t0 || t >= t1) return false;
+        record_hit(rec, t, this);
+        return true;
+    }
+    virtual bool occluded(const ray& r, float t0, float t1) const
+    {
+        float t_near, t_far;
+        if(!slabs(r, t_near, t_far)) return false;
+        return (t_near > t0 && t_near < t1) || (t_far > t0 && t_far < t1);
+    }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
     {
-        pmin = p0; pmax = p1;
-        hitable** list = new hitable*[6];
-        list[0] = new xy_rect(p0.x(), p1.x(), p0.y(), p1.y(), p1.z(), ptr);
-        list[1] = new flip_normals(new xy_rect(p0.x(), p1.x(), p0.y(), p1.y(), p0.z(), ptr));
-        list[2] = new xz_rect(p0.x(), p1.x(), p0.z(), p1.z(), p1.y(), ptr);
-        list[3] = new flip_normals(new xz_rect(p0.x(), p1.x(), p0.z(), p1.z(), p0.y(), ptr));
-        list[4] = new yz_rect(p0.y(), p1.y(), p0.z(), p1.z(), p1.x(), ptr);
-        list[5] = new flip_normals(new yz_rect(p0.y(), p1.y(), p0.z(), p1.z(), p0.x(), ptr));
-        list_ptr = new hitable_list(list, 6);
+        const float* o[3] = {p.ox, p.oy, p.oz};
+        const float* inv[3] = {p.inv_dx, p.inv_dy, p.inv_dz};
+        vfloat t_near(-FLT_MAX), t_far(FLT_MAX);
+        for(int a = 0; a < 3; ++a)
+        {
+            vfloat oa = vfloat::load(o[a]), ia = vfloat::load(inv[a]);
+            vfloat ta = (vfloat(pmin[a]) - oa) * ia;
+            vfloat tb = (vfloat(pmax[a]) - oa) * ia;
+            t_near = vmax(vmin(ta, tb), t_near);
+            t_far = vmin(vmax(ta, tb), t_far);
+        }
+        vfloat t = select(t_near > vfloat(t_min), t_near, t_far);
+        int hits = movemask((t_near <= t_far) & (t > vfloat(t_min)) & (t < vfloat::load(p.t_max))) & mask;
+        if(!hits) return 0;
+        alignas(32) float tt[simd_width];
+        t.store(tt);
+        for(int k = 0; k < simd_width; ++k)
+            if(hits >> k & 1)
+            {
+                p.t_max[k] = tt[k];
+                record_hit(recs[k], tt[k], this);
+            }
+        return hits;
     }
-    bool hit(const ray& r, float t0, float t1, hit_record& rec) const
+    // the face is the plane the hit point lies closest to
+    virtual void shade(const ray& r, hit_record& rec) const
     {
-        return list_ptr->hit(r, t0, t1, rec);
+        vec3 p = r.point_at_parameter(rec.t);
+        int axis = 0;
+        float best = FLT_MAX;
+        bool upper = false;
+        for(int a = 0; a < 3; ++a)
+        {
+            float dl = fabsf(p[a] - pmin[a]), du = fabsf(p[a] - pmax[a]);
+            if(dl < best) { best = dl; axis = a; upper = false; }
+            if(du < best) { best = du; axis = a; upper = true; }
+        }
+        int ax = axis == 0 ? 1 : 0;
+        int bx = axis == 2 ? 1 : 2;
+        rec.p = p;
+        rec.normal = vec3(0);
+        rec.normal[axis] = upper ? 1 : -1;
+        rec.u = (p[ax] - pmin[ax]) / (pmax[ax] - pmin[ax]);
+        rec.v = (p[bx] - pmin[bx]) / (pmax[bx] - pmin[bx]);
+        rec.mat_ptr = mp;
     }
     bool bounding_box(float t0, float t1, aabb& b) const
     {
@@ -33,7 +105,7 @@ public:
         return true;
     }
     vec3 pmin, pmax;
-    hitable* list_ptr;
+    material* mp;
 };
 
-#endif
\ No newline at end of file
+#endif
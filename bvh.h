@@ -4,18 +4,351 @@
 
 #include "hitable.h"
 #include "aabb.h"
+#include "arena.h"
 #include "rand.h"
+#include "thread_pool.h"
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <iostream>
+#include <stdint.h>
 
+//traversal counters-----------------------------------------------------------------------------
+// per thread, for benchmarks. traversals add their node count once when they finish.
+struct traversal_counters
+{
+    uint64_t traversals = 0;
+    uint64_t nodes = 0;
+};
+
+inline traversal_counters& thread_counters()
+{
+    static thread_local traversal_counters c;
+    return c;
+}
+
+//build primitives-------------------------------------------------------------------------------
+// bounds and centroid are fetched once per primitive instead of once per comparison
+struct bvh_primitive
+{
+    aabb box;
+    vec3 centroid;
+    hitable* ptr;
+};
+
+inline void gather_primitives(hitable** l, int begin, int end, float time0, float time1, bvh_primitive* prims)
+{
+    for(int i = begin; i < end; ++i)
+    {
+        if(!l[i]->bounding_box(time0, time1, prims[i].box))
+            std::cerr << "no bounding box in bvh_node constructor\n";
+        prims[i].centroid = prims[i].box.centroid();
+        prims[i].ptr = l[i];
+    }
+}
+
+// chunks of the list are gathered as tasks of pool when there is one
+inline std::vector<bvh_primitive> gather_primitives(hitable** l, int n, float time0, float time1, thread_pool* pool = nullptr)
+{
+    std::vector<bvh_primitive> prims(n);
+    const int chunk = 1 << 14;
+    if(!pool || n <= chunk)
+    {
+        gather_primitives(l, 0, n, time0, time1, prims.data());
+        return prims;
+    }
+    bvh_primitive* p = prims.data();
+    for(int begin = 0; begin < n; begin += chunk)
+    {
+        int end = std::min(n, begin + chunk);
+        pool->submit([=] { gather_primitives(l, begin, end, time0, time1, p); });
+    }
+    pool->wait();
+    return prims;
+}
+
+inline aabb primitive_bounds(const bvh_primitive* prims, int n)
+{
+    aabb b = empty_box();
+    for(int i = 0; i < n; ++i)
+        b = surrounding_box(b, prims[i].box);
+    return b;
+}
+
+//binned sah split-------------------------------------------------------------------------------
+// cost model: one unit per node visit, one per primitive test
+const int bvh_bins = 16;
+const int bvh_max_leaf = 4;
+// levels of any tree from bvh_builder, root included, which is what the fixed
+// traversal stacks of the flattened bvhs are sized for
+const int bvh_max_depth = 64;
+const float bvh_traversal_cost = 1.0f;
+const float bvh_intersect_cost = 1.0f;
+
+// partitions prims and returns the size of the left half, or 0 when a leaf is cheaper.
+// candidate planes are the borders of bvh_bins equal bins over the centroid bounds
+// on every axis (Wald 2007). the chosen axis is stored in split_axis if given.
+inline int bvh_sah_split(bvh_primitive* prims, int n, const aabb& bounds, int* split_axis = nullptr)
+{
+    if(n == 1) return 0;
+    aabb cbounds = empty_box();
+    for(int i = 0; i < n; ++i)
+        cbounds = surrounding_box(cbounds, aabb(prims[i].centroid, prims[i].centroid));
+
+    float best_cost = FLT_MAX;
+    int best_axis = -1, best_bin = 0;
+    for(int axis = 0; axis < 3; ++axis)
+    {
+        float lo = cbounds.min()[axis];
+        float extent = cbounds.max()[axis] - lo;
+        if(extent <= 0) continue;
+        float scale = bvh_bins / extent;
+
+        aabb bin_box[bvh_bins];
+        int bin_count[bvh_bins] = {0};
+        for(int b = 0; b < bvh_bins; ++b) bin_box[b] = empty_box();
+        for(int i = 0; i < n; ++i)
+        {
+            int b = std::min(int((prims[i].centroid[axis] - lo) * scale), bvh_bins - 1);
+            bin_box[b] = surrounding_box(bin_box[b], prims[i].box);
+            ++bin_count[b];
+        }
+
+        // right_area[b] / right_count[b] : everything in bins b+1 .. bvh_bins-1
+        float right_area[bvh_bins];
+        int right_count[bvh_bins];
+        aabb acc = empty_box();
+        int count = 0;
+        for(int b = bvh_bins - 1; b > 0; --b)
+        {
+            acc = surrounding_box(acc, bin_box[b]);
+            count += bin_count[b];
+            right_area[b - 1] = count ? acc.area() : 0;
+            right_count[b - 1] = count;
+        }
+        acc = empty_box();
+        count = 0;
+        for(int b = 0; b < bvh_bins - 1; ++b)
+        {
+            acc = surrounding_box(acc, bin_box[b]);
+            count += bin_count[b];
+            if(count == 0 || right_count[b] == 0) continue;
+            float cost = count * acc.area() + right_count[b] * right_area[b];
+            if(cost < best_cost)
+            {
+                best_cost = cost;
+                best_axis = axis;
+                best_bin = b;
+            }
+        }
+    }
+
+    float leaf_cost = bvh_intersect_cost * n;
+    if(split_axis) *split_axis = best_axis < 0 ? 0 : best_axis;
+    if(best_axis < 0)
+        // every centroid coincides, bins cannot separate them
+        return n > bvh_max_leaf ? n / 2 : 0;
+    best_cost = bvh_traversal_cost + bvh_intersect_cost * best_cost / bounds.area();
+    if(n <= bvh_max_leaf && best_cost >= leaf_cost)
+        return 0;
+
+    float lo = cbounds.min()[best_axis];
+    float scale = bvh_bins / (cbounds.max()[best_axis] - lo);
+    bvh_primitive* mid = std::partition(prims, prims + n, [=](const bvh_primitive& p) {
+        return std::min(int((p.centroid[best_axis] - lo) * scale), bvh_bins - 1) <= best_bin;
+    });
+    return int(mid - prims);
+}
+
+// for subtrees that start deep enough to overrun bvh_max_depth: halves at the
+// centroid median of the widest axis, so n primitives end in leaves within
+// log2(n) < 32 more levels
+inline int bvh_centroid_median(bvh_primitive* prims, int n, int* split_axis)
+{
+    if(n <= bvh_max_leaf) return 0;
+    aabb cbounds = empty_box();
+    for(int i = 0; i < n; ++i)
+        cbounds = surrounding_box(cbounds, aabb(prims[i].centroid, prims[i].centroid));
+    vec3 extent = cbounds.max() - cbounds.min();
+    int axis = extent.x() > extent.y() ? (extent.x() > extent.z() ? 0 : 2) : (extent.y() > extent.z() ? 1 : 2);
+    *split_axis = axis;
+    std::nth_element(prims, prims + n / 2, prims + n, [=](const bvh_primitive& a, const bvh_primitive& b) {
+        return a.centroid[axis] < b.centroid[axis];
+    });
+    return n / 2;
+}
+
+// the old builder: random axis, median split, at most two primitives per leaf
+inline int bvh_median(bvh_primitive* prims, int n, int* split_axis)
+{
+    if(n <= 2) return 0;
+    int axis = int(3 * random());
+    *split_axis = axis;
+    std::nth_element(prims, prims + n / 2, prims + n, [axis](const bvh_primitive& a, const bvh_primitive& b) {
+        return a.box.min()[axis] < b.box.min()[axis];
+    });
+    return n / 2;
+}
+
+//tree quality-----------------------------------------------------------------------------------
+bool bvh_median_split = false; // split like the old random-axis median builder
+bool bvh_report = false;       // print tree quality after every top level build
+int bvh_build_threads = 0;     // 0 : one per hardware thread
+
+// animated hierarchies refit their bounds every frame, and are rebuilt once
+// the sah cost of the refit tree exceeds this factor of the cost when built
+float bvh_refit_threshold = 1.5f;
+int bvh_rebuilds = 0; // by refit(), for the frame reports
+
+struct bvh_stats
+{
+    int primitives = 0;
+    int nodes = 0;
+    int leaves = 0;
+    int depth = 0;
+    float sah_cost = 0; // expected cost of a random ray that hits the root box
+    std::vector<int> leaf_sizes; // leaf_sizes[k] : number of leaves holding k primitives
+
+    // p : area of the node relative to the root
+    void add_interior(float p, int d)
+    {
+        ++nodes;
+        depth = std::max(depth, d);
+        sah_cost += p * bvh_traversal_cost;
+    }
+    void add_leaf(float p, int d, int count)
+    {
+        ++nodes;
+        ++leaves;
+        depth = std::max(depth, d);
+        primitives += count;
+        sah_cost += p * bvh_intersect_cost * count;
+        if(int(leaf_sizes.size()) <= count)
+            leaf_sizes.resize(count + 1, 0);
+        ++leaf_sizes[count];
+    }
+};
+
+inline void print_bvh_report(std::ostream& os, const bvh_stats& s)
+{
+    os << "bvh: " << s.primitives << " primitives, " << s.nodes << " nodes, "
+       << s.leaves << " leaves, depth " << s.depth << ", sah cost " << s.sah_cost << "\n";
+    os << "     leaf sizes:";
+    for(size_t k = 0; k < s.leaf_sizes.size(); ++k)
+        if(s.leaf_sizes[k]) os << " " << k << ":" << s.leaf_sizes[k];
+    os << "\n";
+}
+
+//parallel build---------------------------------------------------------------------------------
+// the binary sah tree every hierarchy is flattened from. subtrees of at least
+// bvh_task_size primitives are built as tasks of their own, so below the first
+// few levels the build runs on every core. children come from one array
+// through an atomic counter: their indices depend on the schedule, but the
+// splits only on the primitives, so the flattened hierarchies come out the
+// same for any thread count.
+const int bvh_task_size = 1 << 12;
+const int bvh_parallel_size = 1 << 15; // smaller lists are built on the calling thread
+
+struct bvh_build_node
+{
+    aabb bounds;
+    int begin, n; // range of bvh_builder::prims
+    int axis;     // split axis of an interior node
+    int child[2]; // -1 : leaf
+    bool leaf() const { return child[0] < 0; }
+};
+
+class bvh_builder
+{
+public:
+    bvh_builder(hitable** l, int n, float time0, float time1)
+    {
+        // the median split draws its axes from thread_rng(), so it stays on this thread
+        int threads = n < bvh_parallel_size || bvh_median_split ? 1 : bvh_build_threads;
+        if(threads <= 0) threads = std::thread::hardware_concurrency();
+        std::unique_ptr<thread_pool> pool(threads > 1 ? new thread_pool(threads) : nullptr);
+        prims = gather_primitives(l, n, time0, time1, pool.get());
+        nodes.resize(std::max(1, 2 * n - 1));
+        next = 1;
+        build(0, 0, n, primitive_bounds(prims.data(), n), pool.get(), 1);
+        if(pool) pool->wait();
+        nodes.resize(next);
+    }
+    const bvh_build_node& root() const { return nodes[0]; }
+
+    std::vector<bvh_primitive> prims; // in leaf order once built
+    std::vector<bvh_build_node> nodes;
+
+private:
+    // depth counts the levels down to node, 1 at the root
+    void build(int index, int begin, int n, const aabb& bounds, thread_pool* pool, int depth)
+    {
+        bvh_build_node& node = nodes[index];
+        node.bounds = bounds;
+        node.begin = begin;
+        node.n = n;
+        node.axis = 0;
+        bvh_primitive* p = prims.data() + begin;
+        int mid = depth + 32 > bvh_max_depth ? bvh_centroid_median(p, n, &node.axis)
+                  : bvh_median_split         ? bvh_median(p, n, &node.axis)
+                                             : bvh_sah_split(p, n, bounds, &node.axis);
+        if(mid == 0)
+        {
+            node.child[0] = node.child[1] = -1;
+            return;
+        }
+        int c = next.fetch_add(2);
+        node.child[0] = c;
+        node.child[1] = c + 1;
+        aabb left = primitive_bounds(&prims[begin], mid);
+        aabb right = primitive_bounds(&prims[begin + mid], n - mid);
+        if(pool && n - mid >= bvh_task_size)
+        {
+            pool->submit([=] { build(c + 1, begin + mid, n - mid, right, pool, depth + 1); });
+            build(c, begin, mid, left, pool, depth + 1);
+            return;
+        }
+        build(c, begin, mid, left, pool, depth + 1);
+        build(c + 1, begin + mid, n - mid, right, pool, depth + 1);
+    }
+
+    std::atomic<int> next;
+};
+
+//bvh_node---------------------------------------------------------------------------------------
 class bvh_node : public hitable
 {
 public:
     bvh_node() = default;
     bvh_node(hitable** l, int n, float time0, float time1);
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const;
     virtual bool bounding_box(float t0, float t1, aabb& box) const;
-    hitable* left;
-    hitable* right;
+    virtual bool animated() const { return dynamic; }
+    virtual void refit(float t0, float t1);
+    void stats(bvh_stats& s) const;
+
+    // null in leaves, which include the root of an empty list with no primitives
+    bvh_node* left = nullptr;
+    bvh_node* right = nullptr;
+    hitable** prims = nullptr; // leaf primitives, a range of the list given to the constructor
+    uint16_t prim_count = 0;
+    bool dynamic = false;      // something below is animated
+    float built_cost = 0;      // root : sah cost when built, the refit baseline
     aabb box;
+private:
+    friend class scene_arena;
+    template<class T, class... A> friend T* make(A&&... args);
+    bvh_node(const bvh_builder& b, const bvh_build_node& node, hitable** l);
+    void stats(bvh_stats& s, float root_area, int depth) const;
+    void set_leaf(hitable** l, int n);
+    void refit_node(float t0, float t1);
+};
+
+template<>
+struct arena_category_of<bvh_node>
+{
+    static const arena_category value = ARENA_ACCEL;
 };
 
 inline bool bvh_node::bounding_box(float t0, float t1, aabb& b) const
@@ -25,87 +358,135 @@ inline bool bvh_node::bounding_box(float t0, float t1, aabb& b) const
 
 inline bool bvh_node::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
 {
+    ++thread_counters().nodes;
     if(box.hit(r, t_min, t_max))
     {
-        hit_record left_rec, right_rec;
-        bool hit_left = left->hit(r, t_min, t_max, left_rec);
-        bool hit_right = right->hit(r, t_min, t_max, right_rec);
-        if(hit_left && hit_right)
+        if(!left)
         {
-            rec = left_rec.t < right_rec.t ? left_rec : right_rec;
-            return true;
-        }else if(hit_left) {
-            rec = left_rec;
-            return true;
-        }else if(hit_right){
-            rec = right_rec;
-            return true;
-        }else 
-            return false;
+            bool hit_anything = false;
+            for(int i = 0; i < prim_count; ++i)
+                if(prims[i]->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            return hit_anything;
+        }
+        // a miss leaves rec alone, so the right child only has to beat the left hit
+        bool hit_left = left->hit(r, t_min, t_max, rec);
+        bool hit_right = right->hit(r, t_min, hit_left ? rec.t : t_max, rec);
+        return hit_left || hit_right;
     }
     else
         return false;
 }
 
-inline int box_x_compare(const void* a, const void* b)
+inline bool bvh_node::occluded(const ray& r, float t_min, float t_max) const
 {
-    aabb box_left, box_right;
-    hitable* ah = *(hitable**)a;
-    hitable* bh = *(hitable**)b;
-    if(!ah->bounding_box(0, 0, box_left) || !bh->bounding_box(0, 0, box_right))
-        std::cerr << "no bounding box in bvh_node constructor\n";
-    if(box_left.min().x() - box_right.min().x() < 0.0)
-        return -1;
-    else return 1;
+    ++thread_counters().nodes;
+    if(!box.hit(r, t_min, t_max))
+        return false;
+    if(!left)
+    {
+        for(int i = 0; i < prim_count; ++i)
+            if(prims[i]->occluded(r, t_min, t_max))
+                return true;
+        return false;
+    }
+    return left->occluded(r, t_min, t_max) || right->occluded(r, t_min, t_max);
 }
 
-inline int box_y_compare(const void* a, const void* b)
+// reorders l so that every leaf references a contiguous range of it
+inline bvh_node::bvh_node(hitable** l, int n, float time0, float time1)
 {
-    aabb box_left, box_right;
-    hitable* ah = *(hitable**)a;
-    hitable* bh = *(hitable**)b;
-    if(!ah->bounding_box(0, 0, box_left) || !bh->bounding_box(0, 0, box_right))
-        std::cerr << "no bounding box in bvh_node constructor\n";
-    if(box_left.min().y() - box_right.min().y() < 0.0)
-        return -1;
-    else return 1;
+    bvh_builder b(l, n, time0, time1);
+    for(int i = 0; i < n; ++i)
+        l[i] = b.prims[i].ptr;
+    *this = bvh_node(b, b.root(), l);
+    if(bvh_report || dynamic)
+    {
+        bvh_stats s;
+        stats(s);
+        built_cost = s.sah_cost;
+        if(bvh_report) print_bvh_report(std::cerr, s);
+    }
 }
 
-inline int box_z_compare(const void* a, const void* b)
+inline void bvh_node::set_leaf(hitable** l, int n)
 {
-    aabb box_left, box_right;
-    hitable* ah = *(hitable**)a;
-    hitable* bh = *(hitable**)b;
-    if(!ah->bounding_box(0, 0, box_left) || !bh->bounding_box(0, 0, box_right))
-        std::cerr << "no bounding box in bvh_node constructor\n";
-    if(box_left.min().z() - box_right.min().z() < 0.0)
-        return -1;
-    else return 1;
+    prims = l;
+    prim_count = uint16_t(n);
+    for(int i = 0; i < n; ++i)
+        dynamic = dynamic || l[i]->animated();
 }
 
-inline bvh_node::bvh_node(hitable** l, int n, float time0, float time1)
+inline bvh_node::bvh_node(const bvh_builder& b, const bvh_build_node& node, hitable** l) : box(node.bounds)
 {
-    int axis = int(3 * random());
-    if(axis == 0)
-        qsort(l, n, sizeof(hitable*), box_x_compare);
-    else if (axis == 1)
-        qsort(l, n, sizeof(hitable*), box_y_compare);
-    else
-        qsort(l, n, sizeof(hitable*), box_z_compare);
+    if(node.leaf())
+    {
+        set_leaf(l + node.begin, node.n);
+        return;
+    }
+    left = make<bvh_node>(b, b.nodes[node.child[0]], l);
+    right = make<bvh_node>(b, b.nodes[node.child[1]], l);
+    dynamic = left->dynamic || right->dynamic;
+}
 
-    if(n == 1)
+// bottom up over the animated subtrees, static ones keep their boxes. a
+// rebuild makes a new tree in the active arena; the old nodes stay there
+// until the scene is reset.
+inline void bvh_node::refit(float t0, float t1)
+{
+    if(!dynamic) return;
+    refit_node(t0, t1);
+    bvh_stats s;
+    stats(s);
+    if(s.sah_cost <= built_cost * bvh_refit_threshold) return;
+    // the leaves cover the list in order, the leftmost one starts it
+    const bvh_node* first = this;
+    while(first->left) first = first->left;
+    hitable** l = first->prims;
+    ++bvh_rebuilds;
+    *this = bvh_node(l, s.primitives, t0, t1);
+}
+
+inline void bvh_node::refit_node(float t0, float t1)
+{
+    if(!dynamic) return;
+    if(!left)
+    {
+        box = empty_box();
+        for(int i = 0; i < prim_count; ++i)
+        {
+            aabb b;
+            if(prims[i]->animated()) prims[i]->refit(t0, t1);
+            prims[i]->bounding_box(t0, t1, b);
+            box = surrounding_box(box, b);
+        }
+        return;
+    }
+    left->refit_node(t0, t1);
+    right->refit_node(t0, t1);
+    box = surrounding_box(left->box, right->box);
+}
+
+inline void bvh_node::stats(bvh_stats& s) const
+{
+    s = bvh_stats();
+    if(!left && prim_count == 0) return; // built over no primitives, like an empty linear_bvh
+    stats(s, box.area(), 1);
+}
+
+inline void bvh_node::stats(bvh_stats& s, float root_area, int depth) const
+{
+    float p = root_area > 0 ? box.area() / root_area : 1;
+    if(!left)
     {
-        left = right = l[0];
-    }else if(n == 2){
-        left = l[0];
-        right = l[1];
-    }else {
-        left = new bvh_node(l, n / 2, time0, time1);
-        right = new bvh_node(l + n / 2, n - n / 2, time0, time1);
+        s.add_leaf(p, depth, prim_count);
+        return;
     }
-    aabb box_left, box_right;
-    if(!left->bounding_box(time0, time1, box_left) || !right->bounding_box(time0, time1, box_right))
-        std::cerr << "no bounding box in bvh_node constructor\n";
-    box = surrounding_box(box_left, box_right);
+    s.add_interior(p, depth);
+    left->stats(s, root_area, depth + 1);
+    right->stats(s, root_area, depth + 1);
 }
-#endif
\ No newline at end of file
+#endif
@@ -2,7 +2,8 @@
 #define CAMERA_H
 
 #include "ray.h"
-#include "rand.h"
+#include "sampler.h"
+#include "packet.h"
 
 class camera
 {
@@ -24,13 +25,26 @@ public:
         horizontal = 2 * half_width * focus_dist * u;
         vertical = 2 * half_height * focus_dist * v;
     }
-    ray get_ray(float s, float t) 
+    ray get_ray(float s, float t, sampler& smp) const
     { 
-        vec3 rd = lens_radius * random_in_unit_disk();
+        float s1, s2;
+        smp.get_2d(s1, s2);
+        vec3 rd = lens_radius * warp_disk(s1, s2);
         vec3 offset = u * rd.x() + v * rd.y();
-        float time = time0 + random() * (time1 - time0);
+        float time = time0 + smp.get_1d() * (time1 - time0);
         return ray(origin + offset, lower_left_corner + s * horizontal + t * vertical - origin - offset, time);
     }
+    // one ray per lane of mask, every lane draws from its own sampler
+    void get_packet(const float* s, const float* t, sampler* smp, int mask, ray_packet& p) const
+    {
+        for(int k = 0; k < simd_width; ++k)
+            if(mask >> k & 1)
+            {
+                p.set(k, get_ray(s[k], t[k], smp[k]));
+                p.smp[k] = &smp[k];
+            }
+        p.prepare(mask);
+    }
 
     vec3 origin, lower_left_corner, horizontal, vertical;
     vec3 u, v, w;
@@ -0,0 +1,118 @@
+// voxel densities for heterogeneous media: sparse bricks of 8^3 voxels, only
+// the ones holding a nonzero voxel stored, and a coarse grid of per brick
+// majorants for the tracking of grid_medium
+#ifndef DENSITY_GRID_H
+#define DENSITY_GRID_H
+
+#include "vec3.h"
+#include <math.h>
+#include <algorithm>
+#include <fstream>
+#include <string>
+#include <vector>
+
+class density_grid
+{
+public:
+    static const int brick_bits = 3;
+    static const int brick_size = 1 << brick_bits; // voxels along a brick edge
+
+    density_grid() = default;
+    // nx * ny * nz densities, x fastest, then y
+    density_grid(int nx, int ny, int nz, const float* dense);
+
+    // voxel (i, j, k) fills [i, i + 1) of voxel space and is 0 outside the grid
+    float voxel(int i, int j, int k) const
+    {
+        if(i < 0 || j < 0 || k < 0 || i >= n[0] || j >= n[1] || k >= n[2]) return 0;
+        int b = brick_index[brick(i >> brick_bits, j >> brick_bits, k >> brick_bits)];
+        if(b < 0) return 0;
+        int m = brick_size - 1;
+        return bricks[(size_t(b) << 3 * brick_bits) + (((k & m) << brick_bits | (j & m)) << brick_bits | (i & m))];
+    }
+    // trilinear between voxel centers, p in voxel space
+    float density(const vec3& p) const
+    {
+        float x = p.x() - 0.5f, y = p.y() - 0.5f, z = p.z() - 0.5f;
+        int i = int(floorf(x)), j = int(floorf(y)), k = int(floorf(z));
+        float u = x - i, v = y - j, w = z - k;
+        float d = 0;
+        for(int dk = 0; dk < 2; ++dk)
+            for(int dj = 0; dj < 2; ++dj)
+                for(int di = 0; di < 2; ++di)
+                    d += (di ? u : 1 - u) * (dj ? v : 1 - v) * (dk ? w : 1 - w) * voxel(i + di, j + dj, k + dk);
+        return d;
+    }
+    // bounds density() over brick (bx, by, bz)
+    float majorant(int bx, int by, int bz) const { return majorants[brick(bx, by, bz)]; }
+    float max_density() const { return max_value; }
+    size_t memory_bytes() const
+    {
+        return brick_index.capacity() * sizeof(int) + bricks.capacity() * sizeof(float)
+             + majorants.capacity() * sizeof(float);
+    }
+
+    int n[3] = {0, 0, 0};  // voxels
+    int bn[3] = {0, 0, 0}; // bricks
+    std::vector<int> brick_index; // per brick, its place in bricks or -1 when all its voxels are 0
+    std::vector<float> bricks;    // brick_size^3 densities per stored brick
+    std::vector<float> majorants; // per brick
+    float max_value = 0;
+
+private:
+    int brick(int bx, int by, int bz) const { return (bz * bn[1] + by) * bn[0] + bx; }
+};
+
+inline density_grid::density_grid(int nx, int ny, int nz, const float* dense)
+{
+    n[0] = nx;
+    n[1] = ny;
+    n[2] = nz;
+    for(int a = 0; a < 3; ++a)
+        bn[a] = (n[a] + brick_size - 1) >> brick_bits;
+    auto at = [&](int i, int j, int k) {
+        return i < 0 || j < 0 || k < 0 || i >= nx || j >= ny || k >= nz ? 0.0f : dense[(size_t(k) * ny + j) * nx + i];
+    };
+    brick_index.assign(size_t(bn[0]) * bn[1] * bn[2], -1);
+    majorants.assign(brick_index.size(), 0);
+    const int bs = brick_size;
+    for(int bz = 0; bz < bn[2]; ++bz)
+        for(int by = 0; by < bn[1]; ++by)
+            for(int bx = 0; bx < bn[0]; ++bx)
+            {
+                // the interpolation inside a brick reaches one voxel beyond it
+                float m = 0, stored = 0;
+                for(int k = bz * bs - 1; k <= bz * bs + bs; ++k)
+                    for(int j = by * bs - 1; j <= by * bs + bs; ++j)
+                        for(int i = bx * bs - 1; i <= bx * bs + bs; ++i)
+                        {
+                            float d = at(i, j, k);
+                            m = std::max(m, d);
+                            bool inside = i >= bx * bs && i < bx * bs + bs && j >= by * bs && j < by * bs + bs
+                                       && k >= bz * bs && k < bz * bs + bs;
+                            if(inside) stored = std::max(stored, d);
+                        }
+                majorants[brick(bx, by, bz)] = m;
+                max_value = std::max(max_value, m);
+                if(stored <= 0) continue;
+                brick_index[brick(bx, by, bz)] = int(bricks.size() >> 3 * brick_bits);
+                for(int k = 0; k < bs; ++k)
+                    for(int j = 0; j < bs; ++j)
+                        for(int i = 0; i < bs; ++i)
+                            bricks.push_back(at(bx * bs + i, by * bs + j, bz * bs + k));
+            }
+    bricks.shrink_to_fit();
+}
+
+// nx * ny * nz little endian 32 bit floats, x fastest, no header
+inline bool load_density_raw(const std::string& path, int nx, int ny, int nz, std::vector<float>& dense)
+{
+    std::ifstream in(path, std::ios::binary | std::ios::ate);
+    size_t count = size_t(nx) * ny * nz;
+    if(!in || nx <= 0 || ny <= 0 || nz <= 0 || size_t(in.tellg()) != count * sizeof(float)) return false;
+    in.seekg(0);
+    dense.resize(count);
+    return bool(in.read((char*)dense.data(), count * sizeof(float)));
+}
+
+#endif
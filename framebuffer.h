@@ -0,0 +1,37 @@
+// linear framebuffer and the tiles the renderers split it into
+#ifndef FRAMEBUFFER_H
+#define FRAMEBUFFER_H
+
+#include "vec3.h"
+#include <vector>
+#include <algorithm>
+
+//framebuffer----------------------------------------------------------------------------------
+// linear (pre-gamma) colors, row 0 is the bottom of the image like v in camera::get_ray
+class framebuffer
+{
+public:
+    framebuffer(int w, int h) : nx(w), ny(h), pixels(size_t(w) * h, vec3(0)) {}
+    vec3& at(int i, int j) { return pixels[size_t(j) * nx + i]; }
+    const vec3& at(int i, int j) const { return pixels[size_t(j) * nx + i]; }
+
+    int nx, ny;
+    std::vector<vec3> pixels;
+};
+
+//tiles----------------------------------------------------------------------------------------
+struct tile
+{
+    int x0, y0, x1, y1;
+};
+
+inline std::vector<tile> make_tiles(int nx, int ny, int size)
+{
+    std::vector<tile> tiles;
+    for(int y = 0; y < ny; y += size)
+        for(int x = 0; x < nx; x += size)
+            tiles.push_back({x, y, std::min(x + size, nx), std::min(y + size, ny)});
+    return tiles;
+}
+
+#endif
@@ -3,9 +3,16 @@
 
 #include "ray.h"
 #include "aabb.h"
+#include "packet.h"
+#include "sampler.h"
 
 class material;
+class hitable;
 
+const int max_instance_chain = 4;
+
+// traversal only sets t, prim and the instance chain; p, normal, uv and
+// material are filled in by finish_hit() once the closest hit is known
 struct hit_record 
 {
     float t;
@@ -13,13 +20,116 @@ struct hit_record
     vec3 p;
     vec3 normal;
     material* mat_ptr;
+    const hitable* prim; // primitive still to shade, null once shaded
+    const hitable* chain[max_instance_chain]; // instances around prim, innermost first
+    int chain_size;
+};
+
+// what a primitive's hit() writes
+inline void record_hit(hit_record& rec, float t, const hitable* prim)
+{
+    rec.t = t;
+    rec.prim = prim;
+    rec.chain_size = 0;
+}
+
+// a point on an emitter, as seen from the point being shaded
+struct light_sample
+{
+    vec3 wi;      // unit direction toward the point
+    float dist;   // distance to the point
+    float pdf;    // solid angle density of wi
+    vec3 emitted;
 };
 
 class hitable
 {
 public:
+    // closest hit in (t_min, t_max), left for finish_hit() to shade. a miss
+    // must leave rec untouched, so aggregates can pass one record down.
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const = 0;
     virtual bool bounding_box(float t0, float t1, aabb& box) const = 0;
+    // any hit in (t_min, t_max), for shadow and visibility rays: stops at the
+    // first one found and computes no hit_record. the default uses hit().
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        hit_record rec;
+        return hit(r, t_min, t_max, rec);
+    }
+    // where the whole line through r enters and leaves a convex shape, for
+    // the boundaries of media; false when it misses. the default finds them
+    // with two hit() calls, shapes with a closed form answer in one step.
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        hit_record rec1, rec2;
+        if(!hit(r, -FLT_MAX, FLT_MAX, rec1)) return false;
+        if(!hit(r, rec1.t + 0.0001f, FLT_MAX, rec2)) return false;
+        t_enter = rec1.t;
+        t_exit = rec2.t;
+        return true;
+    }
+    // closest hits for the lanes of mask. lanes hit closer than p.t_max get
+    // p.t_max and recs updated and are returned. the default traces lane by lane,
+    // with media drawing from the lane's own sampler.
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        int hits = 0;
+        sampler* outer = media_sampler();
+        for(int k = 0; k < simd_width; ++k)
+        {
+            if(!(mask >> k & 1)) continue;
+            media_sampler() = p.smp[k];
+            if(hit(p.get(k), t_min, p.t_max[k], recs[k]))
+            {
+                p.t_max[k] = recs[k].t;
+                hits |= 1 << k;
+            }
+        }
+        media_sampler() = outer;
+        return hits;
+    }
+    // next event estimation, for shapes that can carry a diffuse_light.
+    // sample_light picks a point of the shape visible from o; light_pdf is the
+    // density of picking unit direction d from o, with t set to the distance
+    // of that point, and 0 when d misses the shape.
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const { return false; }
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const { return 0; }
+    // deferred shading. primitives fill in rec from rec.t and r, given in their
+    // own space. instances map r into their child's space, and the shaded
+    // record back out.
+    virtual void shade(const ray& r, hit_record& rec) const {}
+    virtual ray to_local(const ray& r) const { return r; }
+    virtual void to_world(hit_record& rec) const {}
+    // animation. animated() is true when the bounds can change from frame to
+    // frame; refit() then brings cached bounds up to date for the shutter
+    // [t0, t1]. aggregates only refit the children that are animated.
+    virtual bool animated() const { return false; }
+    virtual void refit(float t0, float t1) {}
 };
 
+// completes a record returned by hit() for the same ray r
+inline void finish_hit(const ray& r, hit_record& rec)
+{
+    ray local = r;
+    for(int i = rec.chain_size - 1; i >= 0; --i)
+        local = rec.chain[i]->to_local(local);
+    if(rec.prim)
+    {
+        rec.prim->shade(local, rec);
+        rec.prim = nullptr;
+    }
+    for(int i = 0; i < rec.chain_size; ++i)
+        rec.chain[i]->to_world(rec);
+    rec.chain_size = 0;
+}
+
+// called by an instance whose child was hit by local_r. when the chain is
+// full, the record is shaded right away in the child's space instead.
+inline void push_instance(const hitable* instance, const ray& local_r, hit_record& rec)
+{
+    if(rec.chain_size == max_instance_chain)
+        finish_hit(local_r, rec);
+    rec.chain[rec.chain_size++] = instance;
+}
+
 #endif
\ No newline at end of file
@@ -11,6 +11,31 @@ public:
     hitable_list(hitable** l, int n) {list = l; list_size = n;}
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
     virtual bool bounding_box(float t0, float t1, aabb& box) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        for(int i = 0; i < list_size; ++i)
+            if(list[i]->occluded(r, t_min, t_max))
+                return true;
+        return false;
+    }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        int hits = 0;
+        for(int i = 0; i < list_size; ++i)
+            hits |= list[i]->hit_packet(p, mask, t_min, recs);
+        return hits;
+    }
+    virtual bool animated() const
+    {
+        for(int i = 0; i < list_size; ++i)
+            if(list[i]->animated()) return true;
+        return false;
+    }
+    virtual void refit(float t0, float t1)
+    {
+        for(int i = 0; i < list_size; ++i)
+            if(list[i]->animated()) list[i]->refit(t0, t1);
+    }
 
     hitable** list;
     int list_size;
@@ -18,16 +43,14 @@ public:
 
 inline bool hitable_list::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
 {
-    hit_record temp_rec;
     bool hit_anything = false;
     double cloest_so_far = t_max;
     for(int i = 0; i < list_size; ++i)
     {
-        if(list[i]->hit(r, t_min, cloest_so_far, temp_rec))
+        if(list[i]->hit(r, t_min, cloest_so_far, rec))
         {
             hit_anything = true;
-            cloest_so_far = temp_rec.t;
-            rec = temp_rec;
+            cloest_so_far = rec.t;
         }
     }
     return hit_anything;
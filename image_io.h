@@ -0,0 +1,338 @@
+// image output: binary ppm, png and pfm, encoded on a background thread
+#ifndef IMAGE_IO_H
+#define IMAGE_IO_H
+
+#include "framebuffer.h"
+#include "thread_pool.h"
+#include <stdint.h>
+#include <string.h>
+#include <array>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+//8 bit conversion-----------------------------------------------------------------------------
+// gamma 2 and clamp, rows top to bottom as the file formats want them
+inline std::vector<uint8_t> to_rgb8(const framebuffer& fb)
+{
+    std::vector<uint8_t> rgb(size_t(fb.nx) * fb.ny * 3);
+    uint8_t* out = rgb.data();
+    for(int j = fb.ny - 1; j >= 0; --j)
+        for(int i = 0; i < fb.nx; ++i)
+        {
+            const vec3& col = fb.at(i, j);
+            for(int c = 0; c < 3; ++c)
+            {
+                float v = 255.99f * sqrtf(col[c]);
+                *out++ = v >= 255 ? 255 : v > 0 ? uint8_t(v) : 0; // NaN ends up 0
+            }
+        }
+    return rgb;
+}
+
+//ppm------------------------------------------------------------------------------------------
+inline bool write_ppm(const std::string& path, const framebuffer& fb)
+{
+    std::vector<uint8_t> rgb = to_rgb8(fb);
+    std::ofstream f(path, std::ios::binary);
+    f << "P6\n" << fb.nx << " " << fb.ny << "\n255\n";
+    f.write((const char*)rgb.data(), rgb.size());
+    return bool(f);
+}
+
+//pfm------------------------------------------------------------------------------------------
+// linear radiance before gamma and clamping. pfm rows run bottom to top like
+// the framebuffer, the negative scale marks little endian floats.
+inline bool write_pfm(const std::string& path, const framebuffer& fb)
+{
+    std::ofstream f(path, std::ios::binary);
+    f << "PF\n" << fb.nx << " " << fb.ny << "\n-1.0\n";
+    std::vector<float> row(size_t(fb.nx) * 3);
+    for(int j = 0; j < fb.ny; ++j)
+    {
+        for(int i = 0; i < fb.nx; ++i)
+            for(int c = 0; c < 3; ++c)
+                row[size_t(i) * 3 + c] = fb.at(i, j)[c];
+        f.write((const char*)row.data(), row.size() * sizeof(float));
+    }
+    return bool(f);
+}
+
+//deflate--------------------------------------------------------------------------------------
+// zlib stream of one fixed huffman block, with greedy lz77 matches found
+// through hash chains over a 32k window. far from optimal, but several
+// times smaller than the raw pixels of a rendered image and fast.
+class deflate_writer
+{
+public:
+    std::vector<uint8_t> out;
+
+    void bits(uint32_t v, int n) // lsb first
+    {
+        acc |= uint64_t(v) << count;
+        count += n;
+        while(count >= 8)
+        {
+            out.push_back(uint8_t(acc));
+            acc >>= 8;
+            count -= 8;
+        }
+    }
+    void code(uint32_t c, int n) // huffman codes go msb first
+    {
+        uint32_t r = 0;
+        for(int k = 0; k < n; ++k)
+            r |= (c >> k & 1) << (n - 1 - k);
+        bits(r, n);
+    }
+    void literal(int v)
+    {
+        if(v < 144) code(0x30 + v, 8);
+        else if(v < 256) code(0x190 + v - 144, 9);
+        else if(v < 280) code(v - 256, 7);
+        else code(0xc0 + v - 280, 8);
+    }
+    void match(int len, int dist)
+    {
+        static const int len_base[] = {3, 4, 5, 6, 7, 8, 9, 10, 11, 13, 15, 17, 19, 23, 27, 31,
+                                       35, 43, 51, 59, 67, 83, 99, 115, 131, 163, 195, 227, 258};
+        static const int len_extra[] = {0, 0, 0, 0, 0, 0, 0, 0, 1, 1, 1, 1, 2, 2, 2, 2,
+                                        3, 3, 3, 3, 4, 4, 4, 4, 5, 5, 5, 5, 0};
+        static const int dist_base[] = {1, 2, 3, 4, 5, 7, 9, 13, 17, 25, 33, 49, 65, 97, 129,
+                                        193, 257, 385, 513, 769, 1025, 1537, 2049, 3073, 4097,
+                                        6145, 8193, 12289, 16385, 24577};
+        int l = 28;
+        while(len_base[l] > len) --l;
+        literal(257 + l);
+        bits(len - len_base[l], len_extra[l]);
+        int d = 29;
+        while(dist_base[d] > dist) --d;
+        code(d, 5);
+        bits(dist - dist_base[d], d < 4 ? 0 : d / 2 - 1);
+    }
+    void flush()
+    {
+        if(count > 0) out.push_back(uint8_t(acc));
+        acc = 0;
+        count = 0;
+    }
+
+private:
+    uint64_t acc = 0;
+    int count = 0;
+};
+
+inline uint32_t adler32(const uint8_t* data, size_t n)
+{
+    uint32_t a = 1, b = 0;
+    while(n > 0)
+    {
+        size_t chunk = n < 5552 ? n : 5552; // largest run without overflow
+        n -= chunk;
+        while(chunk--)
+        {
+            a += *data++;
+            b += a;
+        }
+        a %= 65521;
+        b %= 65521;
+    }
+    return b << 16 | a;
+}
+
+inline std::vector<uint8_t> zlib_compress(const uint8_t* data, size_t n)
+{
+    const int window = 32768, min_match = 3, max_match = 258, max_chain = 16;
+    const int hash_bits = 15;
+    std::vector<int> head(1 << hash_bits, -1), prev(window, -1);
+    auto hash = [data](size_t i) {
+        return (uint32_t(data[i]) << 16 ^ uint32_t(data[i + 1]) << 8 ^ data[i + 2]) * 2654435761u >> (32 - hash_bits);
+    };
+    auto insert = [&](size_t i) {
+        if(i + min_match > n) return;
+        uint32_t h = hash(i);
+        prev[i % window] = head[h];
+        head[h] = int(i);
+    };
+
+    deflate_writer w;
+    w.out.push_back(0x78); // deflate, 32k window
+    w.out.push_back(0x01);
+    w.bits(1, 1);          // final block
+    w.bits(1, 2);          // fixed huffman codes
+    size_t i = 0;
+    while(i < n)
+    {
+        int best_len = 0, best_dist = 0;
+        if(i + min_match <= n)
+        {
+            int limit = int(n - i < size_t(max_match) ? n - i : max_match);
+            int cand = head[hash(i)];
+            for(int chain = 0; cand >= 0 && i - cand <= size_t(window) && chain < max_chain; ++chain)
+            {
+                const uint8_t* a = data + cand;
+                const uint8_t* b = data + i;
+                int len = 0;
+                while(len < limit && a[len] == b[len]) ++len;
+                if(len > best_len)
+                {
+                    best_len = len;
+                    best_dist = int(i - cand);
+                    if(len == limit) break;
+                }
+                int next = prev[cand % window];
+                if(next >= cand) break; // slot reused by a newer position
+                cand = next;
+            }
+        }
+        if(best_len >= min_match)
+        {
+            w.match(best_len, best_dist);
+            for(int k = 0; k < best_len; ++k)
+                insert(i + k);
+            i += best_len;
+        }
+        else {
+            w.literal(data[i]);
+            insert(i);
+            ++i;
+        }
+    }
+    w.literal(256); // end of block
+    w.flush();
+    uint32_t a = adler32(data, n);
+    for(int s = 24; s >= 0; s -= 8)
+        w.out.push_back(uint8_t(a >> s));
+    return std::move(w.out);
+}
+
+//png------------------------------------------------------------------------------------------
+inline std::array<uint32_t, 256> make_crc_table()
+{
+    std::array<uint32_t, 256> table;
+    for(uint32_t k = 0; k < 256; ++k)
+    {
+        uint32_t c = k;
+        for(int b = 0; b < 8; ++b)
+            c = c & 1 ? 0xedb88320u ^ c >> 1 : c >> 1;
+        table[k] = c;
+    }
+    return table;
+}
+
+// the table is built once, thread safe: pngs are encoded on the writer's
+// thread and on whichever thread waits for it
+inline uint32_t crc32(const uint8_t* data, size_t n, uint32_t crc = 0)
+{
+    static const std::array<uint32_t, 256> table = make_crc_table();
+    crc = ~crc;
+    for(size_t k = 0; k < n; ++k)
+        crc = table[(crc ^ data[k]) & 0xff] ^ crc >> 8;
+    return ~crc;
+}
+
+inline void png_chunk(std::ofstream& f, const char* type, const uint8_t* data, size_t n)
+{
+    uint8_t head[8] = {uint8_t(n >> 24), uint8_t(n >> 16), uint8_t(n >> 8), uint8_t(n)};
+    memcpy(head + 4, type, 4);
+    uint32_t crc = crc32(data, n, crc32(head + 4, 4));
+    uint8_t tail[4] = {uint8_t(crc >> 24), uint8_t(crc >> 16), uint8_t(crc >> 8), uint8_t(crc)};
+    f.write((const char*)head, 8);
+    f.write((const char*)data, n);
+    f.write((const char*)tail, 4);
+}
+
+inline int paeth(int a, int b, int c)
+{
+    int p = a + b - c;
+    int pa = abs(p - a), pb = abs(p - b), pc = abs(p - c);
+    return pa <= pb && pa <= pc ? a : pb <= pc ? b : c;
+}
+
+// 8 bit rgb. every row takes the filter with the smallest sum of absolute
+// residuals, the usual heuristic from libpng.
+inline bool write_png(const std::string& path, const framebuffer& fb)
+{
+    std::vector<uint8_t> rgb = to_rgb8(fb);
+    size_t stride = size_t(fb.nx) * 3;
+    std::vector<uint8_t> filtered((stride + 1) * fb.ny);
+    std::vector<uint8_t> zero(stride, 0), trial[5];
+    for(auto& t : trial) t.resize(stride);
+    for(int y = 0; y < fb.ny; ++y)
+    {
+        const uint8_t* row = &rgb[y * stride];
+        const uint8_t* up = y > 0 ? &rgb[(y - 1) * stride] : zero.data();
+        int best = 0;
+        long best_sum = -1;
+        for(int type = 0; type < 5; ++type)
+        {
+            long sum = 0;
+            for(size_t x = 0; x < stride; ++x)
+            {
+                int a = x >= 3 ? row[x - 3] : 0, b = up[x], c = x >= 3 ? up[x - 3] : 0;
+                int pred = type == 0 ? 0 : type == 1 ? a : type == 2 ? b : type == 3 ? (a + b) / 2 : paeth(a, b, c);
+                uint8_t r = uint8_t(row[x] - pred);
+                trial[type][x] = r;
+                sum += r < 128 ? r : 256 - r;
+            }
+            if(best_sum < 0 || sum < best_sum)
+            {
+                best = type;
+                best_sum = sum;
+            }
+        }
+        filtered[y * (stride + 1)] = uint8_t(best);
+        memcpy(&filtered[y * (stride + 1) + 1], trial[best].data(), stride);
+    }
+
+    std::ofstream f(path, std::ios::binary);
+    const uint8_t signature[8] = {0x89, 'P', 'N', 'G', '\r', '\n', 0x1a, '\n'};
+    f.write((const char*)signature, 8);
+    uint8_t ihdr[13] = {uint8_t(fb.nx >> 24), uint8_t(fb.nx >> 16), uint8_t(fb.nx >> 8), uint8_t(fb.nx),
+                        uint8_t(fb.ny >> 24), uint8_t(fb.ny >> 16), uint8_t(fb.ny >> 8), uint8_t(fb.ny),
+                        8, 2, 0, 0, 0}; // 8 bit rgb, deflate, adaptive filters, no interlace
+    png_chunk(f, "IHDR", ihdr, 13);
+    std::vector<uint8_t> z = zlib_compress(filtered.data(), filtered.size());
+    png_chunk(f, "IDAT", z.data(), z.size());
+    png_chunk(f, "IEND", nullptr, 0);
+    return bool(f);
+}
+
+//writer---------------------------------------------------------------------------------------
+// the format follows the extension: .png, .pfm, anything else is a binary ppm
+inline bool write_image(const std::string& path, const framebuffer& fb)
+{
+    auto ends_with = [&path](const char* ext) {
+        size_t n = strlen(ext);
+        return path.size() >= n && path.compare(path.size() - n, n, ext) == 0;
+    };
+    if(ends_with(".png")) return write_png(path, fb);
+    if(ends_with(".pfm")) return write_pfm(path, fb);
+    return write_ppm(path, fb);
+}
+
+// encodes and writes on its own thread, so the caller can go on rendering the
+// next frame. submit() copies the framebuffer; the destructor waits for every
+// pending image.
+class image_writer
+{
+public:
+    image_writer() : pool(1) {}
+    ~image_writer() { pool.wait(); }
+
+    void submit(const framebuffer& fb, const std::string& path)
+    {
+        std::shared_ptr<framebuffer> copy(new framebuffer(fb));
+        pool.submit([copy, path] {
+            if(!write_image(path, *copy))
+                std::cerr << "could not write " << path << "\n";
+        });
+    }
+    void wait() { pool.wait(); }
+
+private:
+    thread_pool pool;
+};
+
+#endif
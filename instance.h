@@ -3,6 +3,7 @@
 
 #include "hitable.h"
 #include "ray.h"
+#include "affine.h"
 
 class translate : public hitable
 {
@@ -10,13 +11,29 @@ public:
     translate(hitable* p, const vec3& displacement) : ptr(p), offset(displacement) {}
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
     {
-        ray moved_r(r.origin() - offset, r.direction(), r.time());
+        ray moved_r = to_local(r);
         if(ptr->hit(moved_r, t_min, t_max, rec))
         {
-            rec.p += offset;
+            push_instance(this, moved_r, rec);
             return true;
         }else return false;
     }
+    virtual ray to_local(const ray& r) const
+    {
+        return ray(r.origin() - offset, r.direction(), r.time());
+    }
+    virtual void to_world(hit_record& rec) const
+    {
+        rec.p += offset;
+    }
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        return ptr->occluded(to_local(r), t_min, t_max);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return ptr->interval(to_local(r), t_enter, t_exit);
+    }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
         if(ptr->bounding_box(t0, t1, box))
@@ -25,6 +42,8 @@ public:
             return true;
         }else return false;
     }
+    virtual bool animated() const { return ptr->animated(); }
+    virtual void refit(float t0, float t1) { ptr->refit(t0, t1); }
     hitable* ptr;
     vec3 offset;
 };
@@ -37,7 +56,11 @@ public:
         float radians = (M_PI / 180.0) * angle;
         sin_theta = sin(radians);
         cos_theta = cos(radians);
-        hasbox = ptr->bounding_box(0, 1, bbox);
+        update_box(0, 1);
+    }
+    void update_box(float t0, float t1)
+    {
+        hasbox = ptr->bounding_box(t0, t1, bbox);
         vec3 min(FLT_MAX), max(-FLT_MAX);
         for(int i = 0; i < 2; ++i)
             for(int j = 0; j < 2; ++j)
@@ -62,22 +85,41 @@ public:
     }
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
     {
-        vec3 origin = inverse_rotate_around_y(r.origin());
-        vec3 direction =  inverse_rotate_around_y(r.direction());
-        ray rotated_r(origin, direction, r.time());
-
+        ray rotated_r = to_local(r);
         if(ptr->hit(rotated_r, t_min, t_max, rec))
         {
-            rec.p = rotate_around_y(rec.p);
-            rec.normal = rotate_around_y(rec.normal);
+            push_instance(this, rotated_r, rec);
             return true;
         }else return false;
     }
+    virtual ray to_local(const ray& r) const
+    {
+        return ray(inverse_rotate_around_y(r.origin()), inverse_rotate_around_y(r.direction()), r.time());
+    }
+    virtual void to_world(hit_record& rec) const
+    {
+        rec.p = rotate_around_y(rec.p);
+        rec.normal = rotate_around_y(rec.normal);
+    }
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        return ptr->occluded(to_local(r), t_min, t_max);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return ptr->interval(to_local(r), t_enter, t_exit);
+    }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
         box = bbox;
         return true;
     }
+    virtual bool animated() const { return ptr->animated(); }
+    virtual void refit(float t0, float t1)
+    {
+        ptr->refit(t0, t1);
+        update_box(t0, t1);
+    }
     hitable* ptr;
     float sin_theta, cos_theta;
     bool hasbox;
@@ -95,4 +137,77 @@ private:
     }
 };
 
+// a shared prototype, usually a bvh built once over its geometry (the bottom
+// level), placed by an affine transform. a bvh over instances is the top
+// level: memory grows with unique geometry, not with the number of copies.
+// when mat is set it replaces the materials of the prototype.
+// set_transform() moves an instance between frames; the bvh above it picks
+// the new bounds up on its next refit().
+class instance : public hitable
+{
+public:
+    instance(hitable* p, const affine& world_from_local, material* override_mat = nullptr)
+        : ptr(p), xform(world_from_local), inv(world_from_local.inverse()), mat(override_mat)
+    {
+        update_box(0, 1);
+    }
+    void set_transform(const affine& world_from_local)
+    {
+        xform = world_from_local;
+        inv = world_from_local.inverse();
+        moving = true;
+    }
+    void update_box(float t0, float t1)
+    {
+        aabb b;
+        hasbox = ptr->bounding_box(t0, t1, b);
+        bbox = xform.transform_box(b);
+    }
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+    {
+        // the local direction is not renormalized, so t is the same in both spaces
+        ray local_r = to_local(r);
+        if(ptr->hit(local_r, t_min, t_max, rec))
+        {
+            push_instance(this, local_r, rec);
+            return true;
+        }else return false;
+    }
+    virtual ray to_local(const ray& r) const
+    {
+        return ray(inv.point(r.origin()), inv.vector(r.direction()), r.time());
+    }
+    virtual void to_world(hit_record& rec) const
+    {
+        rec.p = xform.point(rec.p);
+        rec.normal = unit_vector(inv.transposed_vector(rec.normal));
+        if(mat) rec.mat_ptr = mat;
+    }
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        return ptr->occluded(to_local(r), t_min, t_max);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return ptr->interval(to_local(r), t_enter, t_exit);
+    }
+    virtual bool bounding_box(float t0, float t1, aabb& box) const
+    {
+        box = bbox;
+        return hasbox;
+    }
+    virtual bool animated() const { return moving || ptr->animated(); }
+    virtual void refit(float t0, float t1)
+    {
+        if(ptr->animated()) ptr->refit(t0, t1);
+        update_box(t0, t1);
+    }
+    hitable* ptr;
+    affine xform, inv;
+    material* mat;
+    bool moving = false; // set_transform() is called between frames, set before the bvh above is built
+    bool hasbox;
+    aabb bbox;
+};
+
 #endif
\ No newline at end of file
@@ -0,0 +1,163 @@
+// iterative path tracer
+#ifndef INTEGRATOR_H
+#define INTEGRATOR_H
+
+#include "hitable.h"
+#include "material.h"
+#include "light.h"
+#include "volumes.h"
+#include <float.h>
+#include <stdint.h>
+
+struct path_settings
+{
+    int max_depth = 50; // bounces, as the old recursive color()
+    int rr_depth = 5;   // russian roulette from this bounce on, < 0 : never
+    const light_list* lights = nullptr; // next event estimation toward these, null : none
+    const medium_list* media = nullptr; // the scene's media, which shadow rays pass through
+};
+
+// a path in flight
+struct path_state
+{
+    ray r;
+    vec3 radiance = vec3(0);
+    vec3 throughput = vec3(1); // product of the attenuations so far
+    int depth = 0;
+    float scatter_pdf = 0;     // of r's direction when a non specular scatter chose it
+};
+
+// per thread, for paths/s reports
+struct path_counters
+{
+    uint64_t paths = 0;
+    uint64_t segments = 0; // rays traced, camera rays included
+};
+
+inline path_counters& thread_path_counters()
+{
+    static thread_local path_counters c;
+    return c;
+}
+
+inline vec3 background(const ray& r)
+{
+    /*
+    vec3 unit_direction = unit_vector(r.direction());
+    float t = 0.5 * (unit_direction.y() + 1.0);
+    return vec3(1.0 - t) + t * vec3(0.5, 0.7, 1.0);
+    */
+    return vec3(0);
+}
+
+inline float max_component(const vec3& v)
+{
+    return std::max(v.x(), std::max(v.y(), v.z()));
+}
+
+inline float power_heuristic(float a, float b)
+{
+    return a * a / (a * a + b * b);
+}
+
+// next event estimation at rec: light from one sampled emitter point, times
+// the scattering toward it and the transmittance of the media on the way,
+// weighted against finding that point by scattering
+inline vec3 direct_light(const ray& r_in, const hit_record& rec, hitable* world, const light_list& lights,
+                         const medium_list* media, sampler& smp)
+{
+    light_sample ls;
+    if(!lights.sample(rec.p, smp, ls)) return vec3(0);
+    const material_record& m = rec.mat_ptr->record();
+    vec3 f = scatter_value(m, rec, ls.wi);
+    if(max_component(f * ls.emitted) <= 0) return vec3(0);
+    ++thread_path_counters().segments;
+    ray shadow(rec.p, ls.wi, r_in.time());
+    if(world->occluded(shadow, 0.001, ls.dist * 0.999f))
+        return vec3(0);
+    float tr = media ? media->transmittance(shadow, 0.001, ls.dist * 0.999f, smp) : 1;
+    if(tr <= 0) return vec3(0);
+    float w = power_heuristic(ls.pdf, scattering_pdf(m, rec, ls.wi));
+    return tr * w * f * ls.emitted / ls.pdf;
+}
+
+// one bounce of ps at rec, the hit of ps.r: adds the emitted light and replaces
+// ps.r by the scattered ray. returns false when the path ends there: absorbed
+// ray, black throughput, max_depth or russian roulette. a path survives the
+// roulette with probability q and is then weighted by 1 / q, so the estimate
+// stays unbiased.
+// with lights, non specular hits also sample a light directly, and emission
+// found by scattering from them is MIS weighted with the power heuristic.
+inline bool path_bounce(path_state& ps, const hit_record& rec, hitable* world, const path_settings& settings, sampler& smp)
+{
+    smp.start_bounce(ps.depth);
+    const material_record& m = rec.mat_ptr->record();
+    vec3 emitted = emission(m, rec.u, rec.v, rec.p);
+    if(max_component(emitted) > 0)
+    {
+        float w = 1;
+        if(settings.lights && ps.scatter_pdf > 0)
+        {
+            float len = ps.r.direction().length();
+            float light_pdf = settings.lights->pdf(ps.r.origin(), ps.r.direction() / len, rec.t * len);
+            w = power_heuristic(ps.scatter_pdf, light_pdf);
+        }
+        ps.radiance += w * ps.throughput * emitted;
+    }
+    ray scattered;
+    vec3 attenuation;
+    if(ps.depth >= settings.max_depth || !scatter(m, ps.r, rec, attenuation, scattered, smp))
+        return false;
+    ps.scatter_pdf = scattering_pdf(m, rec, scattered.direction());
+    if(settings.lights && ps.scatter_pdf > 0)
+        ps.radiance += ps.throughput * direct_light(ps.r, rec, world, *settings.lights, settings.media, smp);
+    ps.throughput *= attenuation;
+    float q = max_component(ps.throughput);
+    if(q <= 0)
+        return false;
+    if(settings.rr_depth >= 0 && ps.depth + 1 >= settings.rr_depth && q < 1)
+    {
+        if(smp.get_1d() >= q)
+            return false;
+        ps.throughput /= q;
+    }
+    ps.r = scattered;
+    ++ps.depth;
+    return true;
+}
+
+// light arriving along r, whose first hit rec is already known and shaded
+inline vec3 trace_from_hit(const ray& r, hit_record rec, hitable* world, const path_settings& settings, sampler& smp)
+{
+    path_state ps;
+    ps.r = r;
+    path_counters& counters = thread_path_counters();
+    ++counters.paths;
+    ++counters.segments;
+    while(path_bounce(ps, rec, world, settings, smp))
+    {
+        ++counters.segments;
+        if(!world->hit(ps.r, 0.001, FLT_MAX, rec))
+        {
+            ps.radiance += ps.throughput * background(ps.r);
+            break;
+        }
+        finish_hit(ps.r, rec);
+    }
+    return ps.radiance;
+}
+
+inline vec3 trace_path(const ray& r, hitable* world, const path_settings& ps, sampler& smp)
+{
+    hit_record rec;
+    if(world->hit(r, 0.001, FLT_MAX, rec))
+    {
+        finish_hit(r, rec);
+        return trace_from_hit(r, rec, world, ps, smp);
+    }
+    ++thread_path_counters().paths;
+    ++thread_path_counters().segments;
+    return background(r);
+}
+
+#endif
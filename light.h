@@ -0,0 +1,44 @@
+// emitters sampled by next event estimation
+#ifndef LIGHT_H
+#define LIGHT_H
+
+#include "hitable.h"
+#include <math.h>
+#include <vector>
+
+// shapes carrying a diffuse_light, registered by the scene functions.
+// one of them is picked uniformly per shadow ray.
+class light_list
+{
+public:
+    void add(hitable* h) { lights.push_back(h); }
+    bool empty() const { return lights.empty(); }
+    void clear() { lights.clear(); }
+
+    bool sample(const vec3& o, sampler& smp, light_sample& ls) const
+    {
+        int n = int(lights.size());
+        int k = std::min(int(smp.get_1d() * n), n - 1);
+        if(!lights[k]->sample_light(o, smp, ls)) return false;
+        ls.pdf /= n;
+        return true;
+    }
+    // density of sample() choosing unit direction d toward the emitter point
+    // at distance t. only the light actually hit there counts: one further
+    // along d could not have produced that point.
+    float pdf(const vec3& o, const vec3& d, float t) const
+    {
+        for(hitable* l : lights)
+        {
+            float tl;
+            float p = l->light_pdf(o, d, tl);
+            if(p > 0 && fabsf(tl - t) <= 1e-3f * t)
+                return p / lights.size();
+        }
+        return 0;
+    }
+
+    std::vector<hitable*> lights;
+};
+
+#endif
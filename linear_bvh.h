@@ -0,0 +1,318 @@
+// flattened bvh: one contiguous node array, iterative traversal
+#ifndef LINEAR_BVH_H
+#define LINEAR_BVH_H
+
+#include "hitable.h"
+#include "bvh.h"
+#include <stdint.h>
+
+// 32 bytes, two nodes per cache line. the first child of an interior node is
+// the next node in the array, the second one sits at offset (depth first order).
+struct linear_bvh_node
+{
+    float bmin[3], bmax[3];
+    int32_t offset;  // leaf : first primitive, interior : second child
+    uint16_t count;  // leaf : number of primitives, interior : 0
+    uint8_t axis;    // interior : split axis, picks the near child
+    uint8_t dynamic; // something below is animated, refit() visits it
+};
+static_assert(sizeof(linear_bvh_node) == 32, "linear_bvh_node should fill half a cache line");
+
+// slab test with the ray's inverse direction computed once per traversal
+inline bool slab_hit(const float* bmin, const float* bmax, const vec3& o, const vec3& inv_d, float t_min, float t_max)
+{
+    for(int i = 0; i < 3; ++i)
+    {
+        float t0 = (bmin[i] - o[i]) * inv_d[i];
+        float t1 = (bmax[i] - o[i]) * inv_d[i];
+        t_min = std::max(t_min, std::min(t0, t1));
+        t_max = std::min(t_max, std::max(t0, t1));
+    }
+    return t_min <= t_max;
+}
+
+class linear_bvh : public hitable
+{
+public:
+    linear_bvh(hitable** l, int n, float time0, float time1);
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const;
+    virtual bool bounding_box(float t0, float t1, aabb& box) const;
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const;
+    virtual bool animated() const { return !nodes.empty() && nodes[0].dynamic; }
+    virtual void refit(float t0, float t1);
+    void stats(bvh_stats& s) const;
+
+    std::vector<linear_bvh_node> nodes; // empty when built over no primitives
+    std::vector<hitable*> prims;        // in leaf order
+    float built_cost = 0;        // sah cost when built, the refit baseline
+private:
+    int flatten(const bvh_builder& b, const bvh_build_node& node);
+};
+
+template<>
+struct arena_category_of<linear_bvh>
+{
+    static const arena_category value = ARENA_ACCEL;
+};
+
+// the builder's root over no primitives is a leaf that traversal would read as
+// interior, so an empty list leaves nodes empty and every query returns early
+inline linear_bvh::linear_bvh(hitable** l, int n, float time0, float time1)
+{
+    if(n == 0) return;
+    bvh_builder b(l, n, time0, time1);
+    nodes.reserve(b.nodes.size());
+    prims.resize(n);
+    for(int i = 0; i < n; ++i)
+        prims[i] = b.prims[i].ptr;
+    flatten(b, b.root());
+    if(bvh_report || animated())
+    {
+        bvh_stats s;
+        stats(s);
+        built_cost = s.sah_cost;
+        if(bvh_report) print_bvh_report(std::cerr, s);
+    }
+}
+
+// depth first, so the first child of every interior node follows it
+inline int linear_bvh::flatten(const bvh_builder& b, const bvh_build_node& node)
+{
+    int index = int(nodes.size());
+    nodes.emplace_back();
+    for(int i = 0; i < 3; ++i)
+    {
+        nodes[index].bmin[i] = node.bounds.min()[i];
+        nodes[index].bmax[i] = node.bounds.max()[i];
+    }
+    if(node.leaf())
+    {
+        nodes[index].offset = node.begin;
+        nodes[index].count = uint16_t(node.n);
+        nodes[index].dynamic = 0;
+        for(int i = 0; i < node.n; ++i)
+            nodes[index].dynamic |= prims[node.begin + i]->animated();
+        return index;
+    }
+    flatten(b, b.nodes[node.child[0]]);
+    int second = flatten(b, b.nodes[node.child[1]]);
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = uint8_t(node.axis);
+    nodes[index].dynamic = nodes[index + 1].dynamic | nodes[second].dynamic;
+    return index;
+}
+
+// children follow their parent in the array, so one backwards pass refits
+// bottom up. static subtrees are skipped.
+inline void linear_bvh::refit(float t0, float t1)
+{
+    if(!animated()) return;
+    for(int i = int(nodes.size()) - 1; i >= 0; --i)
+    {
+        linear_bvh_node& node = nodes[i];
+        if(!node.dynamic) continue;
+        aabb box = empty_box();
+        if(node.count > 0)
+            for(int k = 0; k < node.count; ++k)
+            {
+                hitable* h = prims[node.offset + k];
+                aabb b;
+                if(h->animated()) h->refit(t0, t1);
+                h->bounding_box(t0, t1, b);
+                box = surrounding_box(box, b);
+            }
+        else {
+            const linear_bvh_node& a = nodes[i + 1];
+            const linear_bvh_node& c = nodes[node.offset];
+            box = aabb(vec3(std::min(a.bmin[0], c.bmin[0]), std::min(a.bmin[1], c.bmin[1]), std::min(a.bmin[2], c.bmin[2])),
+                       vec3(std::max(a.bmax[0], c.bmax[0]), std::max(a.bmax[1], c.bmax[1]), std::max(a.bmax[2], c.bmax[2])));
+        }
+        for(int a = 0; a < 3; ++a)
+        {
+            node.bmin[a] = box.min()[a];
+            node.bmax[a] = box.max()[a];
+        }
+    }
+    bvh_stats s;
+    stats(s);
+    if(s.sah_cost <= built_cost * bvh_refit_threshold) return;
+    std::vector<hitable*> l = prims;
+    ++bvh_rebuilds;
+    *this = linear_bvh(l.data(), int(l.size()), t0, t1);
+}
+
+inline bool linear_bvh::bounding_box(float t0, float t1, aabb& b) const
+{
+    if(nodes.empty())
+    {
+        b = empty_box();
+        return true;
+    }
+    b = aabb(vec3(nodes[0].bmin[0], nodes[0].bmin[1], nodes[0].bmin[2]),
+             vec3(nodes[0].bmax[0], nodes[0].bmax[1], nodes[0].bmax[2]));
+    return true;
+}
+
+// near child first; every hit shrinks t_max so the far side is culled by the slab test
+inline bool linear_bvh::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+    if(nodes.empty()) return false;
+    vec3 o = r.origin();
+    vec3 inv_d(1.0f / r.direction().x(), 1.0f / r.direction().y(), 1.0f / r.direction().z());
+    int dir_neg[3] = {inv_d.x() < 0, inv_d.y() < 0, inv_d.z() < 0};
+    int stack[bvh_max_depth];
+    int sp = 0;
+    int index = 0;
+    bool hit_anything = false;
+    int visited = 0;
+    for(;;)
+    {
+        const linear_bvh_node& node = nodes[index];
+        ++visited;
+        if(slab_hit(node.bmin, node.bmax, o, inv_d, t_min, t_max))
+        {
+            if(node.count > 0)
+            {
+                for(int i = 0; i < node.count; ++i)
+                    if(prims[node.offset + i]->hit(r, t_min, t_max, rec))
+                    {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                if(sp == 0) break;
+                index = stack[--sp];
+            }
+            else if(dir_neg[node.axis]) {
+                stack[sp++] = index + 1;
+                index = node.offset;
+            }
+            else {
+                stack[sp++] = node.offset;
+                index = index + 1;
+            }
+        }
+        else {
+            if(sp == 0) break;
+            index = stack[--sp];
+        }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return hit_anything;
+}
+
+// same walk as hit() with a fixed t_max, returns at the first primitive hit
+inline bool linear_bvh::occluded(const ray& r, float t_min, float t_max) const
+{
+    if(nodes.empty()) return false;
+    vec3 o = r.origin();
+    vec3 inv_d(1.0f / r.direction().x(), 1.0f / r.direction().y(), 1.0f / r.direction().z());
+    int dir_neg[3] = {inv_d.x() < 0, inv_d.y() < 0, inv_d.z() < 0};
+    int stack[bvh_max_depth];
+    int sp = 0;
+    int index = 0;
+    bool blocked = false;
+    int visited = 0;
+    for(;;)
+    {
+        const linear_bvh_node& node = nodes[index];
+        ++visited;
+        if(slab_hit(node.bmin, node.bmax, o, inv_d, t_min, t_max))
+        {
+            if(node.count > 0)
+            {
+                for(int i = 0; i < node.count && !blocked; ++i)
+                    blocked = prims[node.offset + i]->occluded(r, t_min, t_max);
+                if(blocked || sp == 0) break;
+                index = stack[--sp];
+            }
+            else if(dir_neg[node.axis]) {
+                stack[sp++] = index + 1;
+                index = node.offset;
+            }
+            else {
+                stack[sp++] = node.offset;
+                index = index + 1;
+            }
+        }
+        else {
+            if(sp == 0) break;
+            index = stack[--sp];
+        }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return blocked;
+}
+
+// the whole packet walks the tree, near child first by the signs of the first lane.
+// coherent packets are culled by interval bounds before the per lane test, and
+// each stack entry carries the lanes that hit its parent.
+inline int linear_bvh::hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+{
+    if(nodes.empty()) return 0;
+    struct entry { int index, mask; };
+    entry stack[bvh_max_depth];
+    int sp = 0;
+    entry e = {0, mask};
+    int hits = 0;
+    int visited = 0;
+    for(;;)
+    {
+        const linear_bvh_node& node = nodes[e.index];
+        ++visited;
+        int m = 0;
+        if(!p.coherent || packet_may_hit(p, node.bmin, node.bmax, t_min))
+            m = packet_box_hit(p, e.mask, node.bmin, node.bmax, t_min);
+        if(m && node.count > 0)
+        {
+            for(int i = 0; i < node.count; ++i)
+                hits |= prims[node.offset + i]->hit_packet(p, m, t_min, recs);
+        }
+        else if(m) {
+            int near_child = p.neg[node.axis] ? node.offset : e.index + 1;
+            int far_child = p.neg[node.axis] ? e.index + 1 : node.offset;
+            stack[sp++] = {far_child, m};
+            e = {near_child, m};
+            continue;
+        }
+        if(sp == 0) break;
+        e = stack[--sp];
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return hits;
+}
+
+inline void linear_bvh::stats(bvh_stats& s) const
+{
+    s = bvh_stats();
+    if(nodes.empty()) return;
+    auto area = [this](int i) {
+        float dx = nodes[i].bmax[0] - nodes[i].bmin[0];
+        float dy = nodes[i].bmax[1] - nodes[i].bmin[1];
+        float dz = nodes[i].bmax[2] - nodes[i].bmin[2];
+        return 2 * (dx * dy + dy * dz + dz * dx);
+    };
+    float root_area = area(0);
+    // (node, depth) pairs
+    std::vector<std::pair<int, int>> todo(1, std::make_pair(0, 1));
+    while(!todo.empty())
+    {
+        int i = todo.back().first, depth = todo.back().second;
+        todo.pop_back();
+        float p = root_area > 0 ? area(i) / root_area : 1;
+        if(nodes[i].count > 0)
+        {
+            s.add_leaf(p, depth, nodes[i].count);
+            continue;
+        }
+        s.add_interior(p, depth);
+        todo.push_back(std::make_pair(i + 1, depth + 1));
+        todo.push_back(std::make_pair(nodes[i].offset, depth + 1));
+    }
+}
+
+#endif
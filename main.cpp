@@ -3,81 +3,71 @@
 #include "sphere.h"
 #include "camera.h"
 #include "material.h"
-#include "bvh.h"
+#include "accel.h"
 #include "aabb.h"
 #include "rectangle.h"
 #include "box.h"
 #include "instance.h"
 #include "volumes.h"
+#include "mesh_io.h"
+#include "render.h"
+#include "bench.h"
+#include "image_io.h"
+#include "progressive.h"
 #include <iostream>
 #include <fstream>
 #include <string>
 #include <ctime>
+#include <chrono>
+#include <cstring>
 #include <float.h>
 
 #define STB_IMAGE_IMPLEMENTATION
 #include "../stb/stb_image.h"
 
-vec3 color(const ray& r, hitable* world, int depth)
-{
-    hit_record rec;
-    if(world -> hit(r, 0.001, FLT_MAX, rec)) {
-        ray scattered;
-        vec3 attenuation;
-        vec3 emitted = rec.mat_ptr->emitted(rec.u, rec.v, rec.p);
-        if(depth < 50 && rec.mat_ptr->scatter(r, rec, attenuation, scattered))
-        {
-            return emitted + attenuation * color(scattered, world, depth + 1);
-        } 
-        else {
-            return emitted;
-        }
-    }
-    else {
-        /*
-        vec3 unit_direction = unit_vector(r.direction());
-        float t = 0.5 * (unit_direction.y() + 1.0);
-        return vec3(1.0 - t) + t * vec3(0.5, 0.7, 1.0);
-        */
-       return vec3(0);
-    }
-}
+// emitters of the scene being built, for next event estimation
+light_list scene_lights;
+// media, for the transmittance of shadow rays
+medium_list scene_media;
+
+// owns everything the scene functions make
+scene_arena scene_memory;
 
 hitable* basic_scene()
 {
-    hitable** list = new hitable*[4];
-    list[0] = new sphere(vec3(0, 0, -1), 0.5, 
-                        new lambertian(new constant_texture(vec3(0.1, 0.2, 0.5))));
-    list[1] = new sphere(vec3(0, -100.5, -1), 100, 
-                        new lambertian(new constant_texture(vec3(0.8, 0.8, 0.0))));
-    list[2] = new sphere(vec3(1, 0, -1), 0.5, new metal(vec3(0.8, 0.6, 0.2), 0.5));
-    list[3] = new sphere(vec3(-1, 0, -1), 0.5, new dielectric(1.5));
-
-    return new hitable_list(list, 4);
+    hitable** list = make_array<hitable*>(4);
+    list[0] = make<sphere>(vec3(0, 0, -1), 0.5, 
+                        make<lambertian>(make<constant_texture>(vec3(0.1, 0.2, 0.5))));
+    list[1] = make<sphere>(vec3(0, -100.5, -1), 100, 
+                        make<lambertian>(make<constant_texture>(vec3(0.8, 0.8, 0.0))));
+    list[2] = make<sphere>(vec3(1, 0, -1), 0.5, make<metal>(vec3(0.8, 0.6, 0.2), 0.5));
+    list[3] = make<sphere>(vec3(-1, 0, -1), 0.5, make<dielectric>(1.5));
+
+    return make<hitable_list>(list, 4);
 }
 
 hitable* moving_scene()
 {
-    hitable** list = new hitable*[4];
+    hitable** list = make_array<hitable*>(4);
     vec3 center(0, 0, -1);
-    list[0] = new moving_sphere(center, center + vec3(0, 0.3, 0), 0.0, 1.0, 0.2, 
-                new lambertian(new constant_texture(vec3(0.1, 0.2, 0.5))));
-    list[1] = new sphere(vec3(0, -100.5, -1), 100, 
-                new lambertian(new constant_texture(vec3(0.8, 0.8, 0.0))));
-    list[2] = new sphere(vec3(1, 0, -1), 0.5, new metal(vec3(0.8, 0.6, 0.2), 0.5));
-    list[3] = new sphere(vec3(-1, 0, -1), 0.5, new dielectric(1.5));
-
-    return new hitable_list(list, 4);
+    list[0] = make<moving_sphere>(center, center + vec3(0, 0.3, 0), 0.0, 1.0, 0.2, 
+                make<lambertian>(make<constant_texture>(vec3(0.1, 0.2, 0.5))));
+    list[1] = make<sphere>(vec3(0, -100.5, -1), 100, 
+                make<lambertian>(make<constant_texture>(vec3(0.8, 0.8, 0.0))));
+    list[2] = make<sphere>(vec3(1, 0, -1), 0.5, make<metal>(vec3(0.8, 0.6, 0.2), 0.5));
+    list[3] = make<sphere>(vec3(-1, 0, -1), 0.5, make<dielectric>(1.5));
+
+    return make<hitable_list>(list, 4);
 }
 
 hitable* random_scene()
 {
     int n = 500;
-    hitable** list = new hitable*[n+1];
+    hitable** list = make_array<hitable*>(n+1);
 
-    texture* checker = new checker_texture(new constant_texture(vec3(0.2, 0.3, 0.1)),
-                                        new constant_texture(vec3(0.9, 0.9, 0.9)));
-    list[0] = new sphere(vec3(0, -1000, 0), 1000, new lambertian(checker)); //the plate
+    texture* checker = make<checker_texture>(make<constant_texture>(vec3(0.2, 0.3, 0.1)),
+                                        make<constant_texture>(vec3(0.9, 0.9, 0.9)));
+    list[0] = make<sphere>(vec3(0, -1000, 0), 1000, make<lambertian>(checker)); //the plate
 
     int i = 1;
     for(int a = -11; a < 11; ++a) {
@@ -89,131 +79,136 @@ hitable* random_scene()
             {
                 if(choose_mat < 0.8)
                 {
-                    list[i++] = new moving_sphere(center, center+vec3(0, 0.5 * random(), 0), 0.0, 1.0, 0.2, 
-                                    new lambertian(new constant_texture(vec3(random() * random(),
+                    list[i++] = make<moving_sphere>(center, center+vec3(0, 0.5 * random(), 0), 0.0, 1.0, 0.2, 
+                                    make<lambertian>(make<constant_texture>(vec3(random() * random(),
                                                                             random() * random(), 
                                                                             random() * random()))));
                 }
                 else if (choose_mat < 0.95)
                 {
-                    list[i++] = new sphere(center, 0.2, 
-                        new metal(vec3(0.5 * (1 + random()),
+                    list[i++] = make<sphere>(center, 0.2, 
+                        make<metal>(vec3(0.5 * (1 + random()),
                                         0.5 * (1 + random()), 
                                         0.5 * (1 + random())), 
                                 0.5 * (1 + random())));                    
                 }
                 else {
-                    list[i++] = new sphere(center, 0.2, new dielectric(1.5));                    
+                    list[i++] = make<sphere>(center, 0.2, make<dielectric>(1.5));                    
                 }
             }
         }
     }
 
-    list[i++] = new sphere(vec3(0, 1, 0), 1.0, new dielectric(1.5));
-    list[i++] = new sphere(vec3(-4, 1, 0), 1.0, new lambertian(new constant_texture(vec3(0.4, 0.2, 0.1))));   
-    list[i++] = new sphere(vec3(4, 1, 0), 1.0, new metal(vec3(0.7, 0.6, 0.5), 0));                    
+    list[i++] = make<sphere>(vec3(0, 1, 0), 1.0, make<dielectric>(1.5));
+    list[i++] = make<sphere>(vec3(-4, 1, 0), 1.0, make<lambertian>(make<constant_texture>(vec3(0.4, 0.2, 0.1))));   
+    list[i++] = make<sphere>(vec3(4, 1, 0), 1.0, make<metal>(vec3(0.7, 0.6, 0.5), 0));                    
                  
-    return new bvh_node(list, i, 0, 1);
+    return make_bvh(list, i, 0, 1);
 }
 
 hitable* two_spheres()
 {
-    texture* checker = new checker_texture(new constant_texture(vec3(0.2, 0.3, 0.1)),
-                                        new constant_texture(vec3(0.9, 0.9, 0.9)));
-    hitable** list = new hitable*[2];
-    list[0] = new sphere(vec3(0, -10, 0), 10, new lambertian( checker));
-    list[1] = new sphere(vec3(0, 10, 0), 10, new lambertian( checker));
+    texture* checker = make<checker_texture>(make<constant_texture>(vec3(0.2, 0.3, 0.1)),
+                                        make<constant_texture>(vec3(0.9, 0.9, 0.9)));
+    hitable** list = make_array<hitable*>(2);
+    list[0] = make<sphere>(vec3(0, -10, 0), 10, make<lambertian>( checker));
+    list[1] = make<sphere>(vec3(0, 10, 0), 10, make<lambertian>( checker));
 
-    return new hitable_list(list, 2);
+    return make<hitable_list>(list, 2);
 }
 
 hitable* perlin_two_spheres()
 {
-    texture* pertex = new noise_texture(4);
-    hitable** list = new hitable*[2];
-    list[0] = new sphere(vec3(0, -1000, 0), 1000, new lambertian( pertex));
-    list[1] = new sphere(vec3(0, 2, 0), 2, new lambertian( pertex));
-    return new hitable_list(list, 2);
+    texture* pertex = make<noise_texture>(4);
+    hitable** list = make_array<hitable*>(2);
+    list[0] = make<sphere>(vec3(0, -1000, 0), 1000, make<lambertian>( pertex));
+    list[1] = make<sphere>(vec3(0, 2, 0), 2, make<lambertian>( pertex));
+    return make<hitable_list>(list, 2);
 }
 
 hitable* image_texture_sphere()
 {
     int nx, ny, nn;
     unsigned char* tex_data = stbi_load("texture/wall_albedo.png", &nx, &ny, &nn, 0);
-    material* mat = new lambertian(new image_texture(tex_data, nx, ny));
+    arena_own(tex_data, stbi_image_free);
+    material* mat = make<lambertian>(make<image_texture>(tex_data, nx, ny));
 
-    hitable** list = new hitable*[2];
-    list[0] = new sphere(vec3(0, -1000, 0), 1000, new lambertian(new constant_texture(vec3(0.8, 0.8, 0.0))));
-    list[1] = new sphere(vec3(0, 1, 0), 1, mat);
-    return new hitable_list(list, 2);
+    hitable** list = make_array<hitable*>(2);
+    list[0] = make<sphere>(vec3(0, -1000, 0), 1000, make<lambertian>(make<constant_texture>(vec3(0.8, 0.8, 0.0))));
+    list[1] = make<sphere>(vec3(0, 1, 0), 1, mat);
+    return make<hitable_list>(list, 2);
 }
 
 hitable* simple_light()
 {
-    texture* pertex = new noise_texture(4);
-    hitable** list = new hitable*[4];
-    list[0] = new sphere(vec3(0, -1000, 0), 1000, new lambertian( pertex));
-    list[1] = new sphere(vec3(0, 2, 0), 2, new lambertian( pertex));
-    list[2] = new sphere(vec3(0, 7, 0), 2, new diffuse_light(new constant_texture(vec3(4))));
-    list[3] = new xy_rect(3, 5, 1, 3, -2, new diffuse_light(new constant_texture(vec3(4))));
-    return new hitable_list(list, 4);
+    texture* pertex = make<noise_texture>(4);
+    hitable** list = make_array<hitable*>(4);
+    list[0] = make<sphere>(vec3(0, -1000, 0), 1000, make<lambertian>( pertex));
+    list[1] = make<sphere>(vec3(0, 2, 0), 2, make<lambertian>( pertex));
+    list[2] = make<sphere>(vec3(0, 7, 0), 2, make<diffuse_light>(make<constant_texture>(vec3(4))));
+    list[3] = make<xy_rect>(3, 5, 1, 3, -2, make<diffuse_light>(make<constant_texture>(vec3(4))));
+    scene_lights.add(list[2]);
+    scene_lights.add(list[3]);
+    return make<hitable_list>(list, 4);
 }
 
 hitable* cornell_box()
 {
-    hitable** list = new hitable*[6];
+    hitable** list = make_array<hitable*>(8);
 
-    material* red = new lambertian(new constant_texture(vec3(0.65, 0.05, 0.05)));
-    material* white = new lambertian(new constant_texture(vec3(0.73)));
-    material* green = new lambertian(new constant_texture(vec3(0.12, 0.45, 0.15)));
-    material* light = new diffuse_light(new constant_texture(vec3(15)));
+    material* red = make<lambertian>(make<constant_texture>(vec3(0.65, 0.05, 0.05)));
+    material* white = make<lambertian>(make<constant_texture>(vec3(0.73)));
+    material* green = make<lambertian>(make<constant_texture>(vec3(0.12, 0.45, 0.15)));
+    material* light = make<diffuse_light>(make<constant_texture>(vec3(15)));
     int i = 0;
-    list[i++] = new flip_normals(new yz_rect(0, 555, 0, 555, 555, green));
-    list[i++] = new yz_rect(0, 555, 0, 555, 0, red);
-    list[i++] = new xz_rect(213, 343, 227, 332, 554, light);
-    list[i++] = new flip_normals(new xz_rect(0, 555, 0, 555, 555, white));
-    list[i++] = new xz_rect(0, 555, 0, 555, 0, white);
-    list[i++] = new flip_normals(new xy_rect(0, 555, 0, 555, 555, white));
-
-    list[i++] = new translate(new rotate_y(new box(vec3(0), vec3(165), white), -18), vec3(130, 0, 65));
-    list[i++] = new translate(new rotate_y(new box(vec3(0), vec3(165, 330, 165), white), 15), vec3(265, 0, 295));
-
-    return new hitable_list(list, i);
+    list[i++] = make<flip_normals>(make<yz_rect>(0, 555, 0, 555, 555, green));
+    list[i++] = make<yz_rect>(0, 555, 0, 555, 0, red);
+    list[i++] = make<xz_rect>(213, 343, 227, 332, 554, light);
+    scene_lights.add(list[i - 1]);
+    list[i++] = make<flip_normals>(make<xz_rect>(0, 555, 0, 555, 555, white));
+    list[i++] = make<xz_rect>(0, 555, 0, 555, 0, white);
+    list[i++] = make<flip_normals>(make<xy_rect>(0, 555, 0, 555, 555, white));
+
+    list[i++] = make<translate>(make<rotate_y>(make<box>(vec3(0), vec3(165), white), -18), vec3(130, 0, 65));
+    list[i++] = make<translate>(make<rotate_y>(make<box>(vec3(0), vec3(165, 330, 165), white), 15), vec3(265, 0, 295));
+
+    return make<hitable_list>(list, i);
 }
 
 hitable* cornell_smoke()
 {
-    hitable** list = new hitable*[8];
+    hitable** list = make_array<hitable*>(8);
 
-    material* red = new lambertian(new constant_texture(vec3(0.65, 0.05, 0.05)));
-    material* white = new lambertian(new constant_texture(vec3(0.73)));
-    material* green = new lambertian(new constant_texture(vec3(0.12, 0.45, 0.15)));
-    material* light = new diffuse_light(new constant_texture(vec3(7)));
+    material* red = make<lambertian>(make<constant_texture>(vec3(0.65, 0.05, 0.05)));
+    material* white = make<lambertian>(make<constant_texture>(vec3(0.73)));
+    material* green = make<lambertian>(make<constant_texture>(vec3(0.12, 0.45, 0.15)));
+    material* light = make<diffuse_light>(make<constant_texture>(vec3(7)));
     int i = 0;
-    list[i++] = new flip_normals(new yz_rect(0, 555, 0, 555, 555, green));
-    list[i++] = new yz_rect(0, 555, 0, 555, 0, red);
-    list[i++] = new xz_rect(113, 443, 127, 432, 554, light);
-    list[i++] = new flip_normals(new xz_rect(0, 555, 0, 555, 555, white));
-    list[i++] = new xz_rect(0, 555, 0, 555, 0, white);
-    list[i++] = new flip_normals(new xy_rect(0, 555, 0, 555, 555, white));
+    list[i++] = make<flip_normals>(make<yz_rect>(0, 555, 0, 555, 555, green));
+    list[i++] = make<yz_rect>(0, 555, 0, 555, 0, red);
+    list[i++] = make<xz_rect>(113, 443, 127, 432, 554, light);
+    scene_lights.add(list[i - 1]);
+    list[i++] = make<flip_normals>(make<xz_rect>(0, 555, 0, 555, 555, white));
+    list[i++] = make<xz_rect>(0, 555, 0, 555, 0, white);
+    list[i++] = make<flip_normals>(make<xy_rect>(0, 555, 0, 555, 555, white));
 
-    hitable* b1 = new translate(new rotate_y(new box(vec3(0), vec3(165), white), -18), vec3(130, 0, 65));
-    hitable* b2 = new translate(new rotate_y(new box(vec3(0), vec3(165, 330, 165), white), 15), vec3(265, 0, 295));
+    hitable* b1 = make<translate>(make<rotate_y>(make<box>(vec3(0), vec3(165), white), -18), vec3(130, 0, 65));
+    hitable* b2 = make<translate>(make<rotate_y>(make<box>(vec3(0), vec3(165, 330, 165), white), 15), vec3(265, 0, 295));
 
-    list[i++] = new constant_medium(b1, 0.01, new constant_texture(vec3(1)));
-    list[i++] = new constant_medium(b2, 0.01, new constant_texture(vec3(0)));
+    list[i++] = scene_media.add(make<constant_medium>(b1, 0.01, make<constant_texture>(vec3(1))));
+    list[i++] = scene_media.add(make<constant_medium>(b2, 0.01, make<constant_texture>(vec3(0))));
 
-    return new hitable_list(list, i);
+    return make<hitable_list>(list, i);
 }
 
 hitable* final()
 {
     int nb = 20;
-    hitable** list = new hitable*[30];
-    hitable** boxlist = new hitable*[10000]; // floor
-    hitable** boxlist2 = new hitable*[10000]; // bubble box
-    material* white = new lambertian(new constant_texture(vec3(0.73)));
-    material* ground = new lambertian(new constant_texture(vec3(0.48, 0.83, 0.53)));
+    hitable** list = make_array<hitable*>(30);
+    hitable** boxlist = make_array<hitable*>(10000); // floor
+    hitable** boxlist2 = make_array<hitable*>(10000); // bubble box
+    material* white = make<lambertian>(make<constant_texture>(vec3(0.73)));
+    material* ground = make<lambertian>(make<constant_texture>(vec3(0.48, 0.83, 0.53)));
 
     //floor
     int b = 0;
@@ -228,111 +223,559 @@ hitable* final()
             float x1 = x0 + w;
             float y1 = 100 * (random() + 0.01);
             float z1 = z0 + w;
-            boxlist[b++] = new box(vec3(x0, y0, z0), vec3(x1, y1, z1), ground);
+            boxlist[b++] = make<box>(vec3(x0, y0, z0), vec3(x1, y1, z1), ground);
         }
     int l = 0;
-    list[l++] = new bvh_node(boxlist, b, 0, 1);
+    list[l++] = make_bvh(boxlist, b, 0, 1);
 
     //light
-    material* light = new diffuse_light(new constant_texture(vec3(7)));
-    list[l++] = new xz_rect(123, 423, 147, 412, 554, light);
+    material* light = make<diffuse_light>(make<constant_texture>(vec3(7)));
+    list[l++] = make<xz_rect>(123, 423, 147, 412, 554, light);
+    scene_lights.add(list[l - 1]);
 
     //spheres metal / moving / dieletric
     vec3 center(400, 400, 200);
-    list[l++] = new moving_sphere(center, center + vec3(30, 0, 0), 0, 1, 50, new lambertian(new constant_texture(vec3(0.7, 0.3, 0.1))));
-    list[l++] = new sphere(vec3(260, 150, 45), 50, new dielectric(1.5));
-    list[l++] = new sphere(vec3(0, 150, 145), 50, new metal(vec3(0.8, 0.8, 0.9), 10));
-    hitable* boundary = new sphere(vec3(360, 150, 145), 70, new dielectric(1.5));
+    list[l++] = make<moving_sphere>(center, center + vec3(30, 0, 0), 0, 1, 50, make<lambertian>(make<constant_texture>(vec3(0.7, 0.3, 0.1))));
+    list[l++] = make<sphere>(vec3(260, 150, 45), 50, make<dielectric>(1.5));
+    list[l++] = make<sphere>(vec3(0, 150, 145), 50, make<metal>(vec3(0.8, 0.8, 0.9), 10));
+    hitable* boundary = make<sphere>(vec3(360, 150, 145), 70, make<dielectric>(1.5));
     list[l++] = boundary;
 
     //smoke in glass
-    list[l++] = new constant_medium(boundary, 0.2, new constant_texture(vec3(0.2, 0.4, 0.9)));
+    list[l++] = scene_media.add(make<constant_medium>(boundary, 0.2, make<constant_texture>(vec3(0.2, 0.4, 0.9))));
 
     //fog
-    boundary = new sphere(vec3(0), 5000, new dielectric(1.5));
-    list[l++] = new constant_medium(boundary, 0.0001, new constant_texture(vec3(1)));
+    boundary = make<sphere>(vec3(0), 5000, make<dielectric>(1.5));
+    list[l++] = scene_media.add(make<constant_medium>(boundary, 0.0001, make<constant_texture>(vec3(1))));
 
     //texture spheres
     int nx, ny, nn;
     unsigned char* tex_data = stbi_load("texture/wall_albedo.png", &nx, &ny, &nn, 0);
-    material* wall_mat = new lambertian(new image_texture(tex_data, nx, ny));
-    list[l++] = new sphere(vec3(400, 200, 400), 100, wall_mat);
-    texture* pertex = new noise_texture(0.1);
-    list[l++] = new sphere(vec3(220, 280, 300), 80, new lambertian(pertex));
+    arena_own(tex_data, stbi_image_free);
+    material* wall_mat = make<lambertian>(make<image_texture>(tex_data, nx, ny));
+    list[l++] = make<sphere>(vec3(400, 200, 400), 100, wall_mat);
+    texture* pertex = make<noise_texture>(0.1);
+    list[l++] = make<sphere>(vec3(220, 280, 300), 80, make<lambertian>(pertex));
     
     //bubble box
     int ns = 100;
     for(int j = 0; j < ns; ++j)
-        boxlist2[j] = new sphere(vec3(165 * random(), 165 * random(), 165 * random()), 10, white);
-    list[l++] = new translate(new rotate_y(new bvh_node(boxlist2, ns, 0, 1), 15), vec3(-100, 270, 395));
+        boxlist2[j] = make<sphere>(vec3(165 * random(), 165 * random(), 165 * random()), 10, white);
+    list[l++] = make<instance>(make_bvh(boxlist2, ns, 0, 1), affine::translation(vec3(-100, 270, 395)) * affine::rotation(vec3(0, 1, 0), 15));
 
     
-    return new hitable_list(list, l);
+    return make<hitable_list>(list, l);
+}
+
+// the raw density file of the volume scene and its voxel counts. without
+// one the scene makes a cloud of perlin turbulence.
+std::string volume_path;
+int volume_dims[3] = {0, 0, 0};
+
+// a heterogeneous cloud in the cornell box
+hitable* volume_scene()
+{
+    std::vector<float> dense;
+    int n[3] = {volume_dims[0], volume_dims[1], volume_dims[2]};
+    if(volume_path.empty() || !load_density_raw(volume_path, n[0], n[1], n[2], dense))
+    {
+        if(!volume_path.empty())
+            std::cerr << "could not read " << volume_path << " as " << n[0] << "x" << n[1] << "x" << n[2] << " floats\n";
+        n[0] = n[1] = n[2] = 96;
+        dense.assign(size_t(n[0]) * n[1] * n[2], 0);
+        for(int k = 0; k < n[2]; ++k)
+            for(int j = 0; j < n[1]; ++j)
+                for(int i = 0; i < n[0]; ++i)
+                {
+                    vec3 p((i + 0.5f) / n[0], (j + 0.5f) / n[1], (k + 0.5f) / n[2]);
+                    vec3 q = p - vec3(0.5, 0.45, 0.5);
+                    float r = sqrtf(q.x() * q.x() + 1.5f * q.y() * q.y() + q.z() * q.z()) / 0.45f;
+                    float d = 2 * (1 - r) + 2 * perlin().turb(5 * p, 5) - 0.9f;
+                    dense[(size_t(k) * n[1] + j) * n[0] + i] = std::max(0.0f, d);
+                }
+    }
+    density_grid* grid = make<density_grid>(n[0], n[1], n[2], dense.data());
+    arena_add_external(ARENA_PRIMITIVES, grid->memory_bytes());
+    size_t bricks = grid->brick_index.size();
+    size_t stored = grid->bricks.size() >> 3 * density_grid::brick_bits;
+    std::cerr << n[0] << "x" << n[1] << "x" << n[2] << " voxels, " << stored << " of " << bricks
+              << " bricks stored, " << grid->memory_bytes() / 1024 << "KB\n";
+
+    hitable** list = make_array<hitable*>(7);
+    material* red = make<lambertian>(make<constant_texture>(vec3(0.65, 0.05, 0.05)));
+    material* white = make<lambertian>(make<constant_texture>(vec3(0.73)));
+    material* green = make<lambertian>(make<constant_texture>(vec3(0.12, 0.45, 0.15)));
+    material* light = make<diffuse_light>(make<constant_texture>(vec3(7)));
+    int i = 0;
+    list[i++] = make<flip_normals>(make<yz_rect>(0, 555, 0, 555, 555, green));
+    list[i++] = make<yz_rect>(0, 555, 0, 555, 0, red);
+    list[i++] = make<xz_rect>(113, 443, 127, 432, 554, light);
+    scene_lights.add(list[i - 1]);
+    list[i++] = make<flip_normals>(make<xz_rect>(0, 555, 0, 555, 555, white));
+    list[i++] = make<xz_rect>(0, 555, 0, 555, 0, white);
+    list[i++] = make<flip_normals>(make<xy_rect>(0, 555, 0, 555, 555, white));
+    list[i++] = scene_media.add(make<grid_medium>(grid, vec3(90, 0, 90), vec3(465, 375, 465), 0.05f, make<constant_texture>(vec3(0.9))));
+    return make<hitable_list>(list, i);
+}
+
+// an instance of the instances scene that turns about the vertical through
+// center, at speed degrees per second; every other row also circles the origin
+struct spinning_instance
+{
+    instance* inst;
+    affine base;
+    vec3 center;
+    float speed;
+    bool orbits;
+};
+std::vector<spinning_instance> spinners;
+
+// one cluster of spheres built into a bvh once, placed many times by
+// instances with their own transform and material, under a bvh of instances
+hitable* instanced_scene()
+{
+    int ns = 1000;
+    hitable** cluster = make_array<hitable*>(ns);
+    material* white = make<lambertian>(make<constant_texture>(vec3(0.73)));
+    for(int j = 0; j < ns; ++j)
+        cluster[j] = make<sphere>(vec3(165 * random(), 165 * random(), 165 * random()), 6, white);
+    hitable* prototype = make_bvh(cluster, ns, 0, 1);
+
+    material* palette[] = {
+        nullptr, // the prototype's own
+        make<lambertian>(make<constant_texture>(vec3(0.65, 0.05, 0.05))),
+        make<lambertian>(make<constant_texture>(vec3(0.12, 0.45, 0.15))),
+        make<metal>(vec3(0.8, 0.6, 0.2), 0.1),
+        make<dielectric>(1.5)};
+    int n = 10;
+    hitable** instances = make_array<hitable*>(n * n);
+    int k = 0;
+    for(int i = 0; i < n; ++i)
+        for(int j = 0; j < n; ++j)
+        {
+            vec3 axis(random() - 0.5, random() - 0.5, random() - 0.5);
+            affine xf = affine::translation(vec3(-900 + 200 * i, 120, -900 + 200 * j))
+                      * affine::rotation(axis, 360 * random())
+                      * affine::scaling(vec3(0.6 + 0.4 * random(), 0.6 + 0.4 * random(), 0.6 + 0.4 * random()))
+                      * affine::translation(vec3(-82.5));
+            instance* inst = make<instance>(prototype, xf, palette[std::min(int(5 * random()), 4)]);
+            inst->moving = true;
+            spinners.push_back({inst, xf, vec3(-900 + 200 * i, 120, -900 + 200 * j), 30.0f + 15 * (k % 5), j % 2 == 1});
+            instances[k++] = inst;
+        }
+
+    hitable** list = make_array<hitable*>(3);
+    int l = 0;
+    list[l++] = make_bvh(instances, k, 0, 1);
+    list[l++] = make<box>(vec3(-1100, -20, -1100), vec3(1100, 0, 1100), make<lambertian>(make<constant_texture>(vec3(0.48, 0.83, 0.53))));
+    list[l++] = make<xz_rect>(-400, 400, -400, 400, 1000, make<diffuse_light>(make<constant_texture>(vec3(10))));
+    scene_lights.add(list[l - 1]);
+    return make<hitable_list>(list, l);
+}
+
+// the obj or ply file of the mesh scene, which falls back to a bumpy sphere
+// of a million triangles
+std::string mesh_path;
+
+hitable* mesh_scene()
+{
+    triangle_mesh* mesh = make<triangle_mesh>();
+    auto start = std::chrono::steady_clock::now();
+    if(mesh_path.empty() || !load_mesh(mesh_path, *mesh))
+    {
+        *mesh = triangle_mesh(); // a failed load may have left vertices behind
+        int n = 500, m = 2 * n;
+        for(int i = 0; i <= n; ++i)
+            for(int j = 0; j < m; ++j)
+            {
+                float theta = M_PI * i / n, phi = 2 * M_PI * j / m;
+                float r = 1 + 0.05f * sinf(12 * theta) * sinf(12 * phi) + 0.02f * sinf(40 * theta + 3 * phi);
+                mesh->add_vertex(r * vec3(sinf(theta) * cosf(phi), cosf(theta), sinf(theta) * sinf(phi)));
+            }
+        for(int i = 0; i < n; ++i)
+            for(int j = 0; j < m; ++j)
+            {
+                int a = i * m + j, b = i * m + (j + 1) % m;
+                mesh->add_triangle(a, b, a + m);
+                mesh->add_triangle(b, b + m, a + m);
+            }
+    }
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cerr << mesh->triangle_count() << " triangles, " << mesh->vertex_count() << " vertices in "
+              << elapsed.count() << "s\n";
+
+    // scaled to 2 units and stood on the floor
+    aabb b = mesh->bounds();
+    vec3 extent = b.max() - b.min();
+    float s = 2 / fmax(extent.x(), fmax(extent.y(), extent.z()));
+    mesh->transform(affine::scaling(vec3(s)) * affine::translation(vec3(-b.centroid().x(), -b.min().y(), -b.centroid().z())));
+    mesh->mat = make<lambertian>(make<constant_texture>(vec3(0.8, 0.5, 0.3)));
+    hitable** triangles = make_array<hitable*>(mesh->triangle_count());
+    mesh->make_triangles(triangles);
+    arena_add_external(ARENA_PRIMITIVES, mesh->memory_bytes());
+
+    hitable** list = make_array<hitable*>(3);
+    int l = 0;
+    list[l++] = make_bvh(triangles, mesh->triangle_count(), 0, 1);
+    list[l++] = make<box>(vec3(-10, -1, -10), vec3(10, 0, 10), make<lambertian>(make<constant_texture>(vec3(0.73))));
+    list[l++] = make<xz_rect>(-1, 1, -1, 1, 4, make<diffuse_light>(make<constant_texture>(vec3(12))));
+    scene_lights.add(list[l - 1]);
+    return make<hitable_list>(list, l);
+}
+
+void animate_instances(float time)
+{
+    for(const spinning_instance& s : spinners)
+    {
+        affine xf = affine::translation(s.center) * affine::rotation(vec3(0, 1, 0), s.speed * time)
+                  * affine::translation(-s.center) * s.base;
+        if(s.orbits) xf = affine::rotation(vec3(0, 1, 0), 20 * time) * xf;
+        s.inst->set_transform(xf);
+    }
+}
+
+struct scene_preset
+{
+    const char* name;
+    hitable* (*build)();
+    vec3 lookfrom, lookat;
+    float vfov, aperture, dist_to_focus;
+    void (*animate)(float time) = nullptr; // moves the scene to a frame's time, nullptr for still scenes
+};
+
+const scene_preset presets[] = {
+    {"basic",   basic_scene,          vec3(3, 3, 2),         vec3(0, 0, -1),     20, 0.2, 5.196},
+    {"moving",  moving_scene,         vec3(3, 3, 2),         vec3(0, 0, -1),     20, 0.2, 5.196},
+    {"random",  random_scene,         vec3(13, 2, 3),        vec3(0, 0, 0),      20, 0.0, 10.0},
+    {"checker", two_spheres,          vec3(13, 2, 3),        vec3(0, 0, 0),      20, 0.0, 10.0},
+    {"perlin",  perlin_two_spheres,   vec3(13, 2, 3),        vec3(0, 0, 0),      20, 0.0, 10.0},
+    {"earth",   image_texture_sphere, vec3(13, 2, 3),        vec3(0, 0, 0),      20, 0.0, 10.0},
+    {"light",   simple_light,         vec3(26, 3, 6),        vec3(0, 2, 0),      20, 0.0, 10.0},
+    {"cornell", cornell_box,          vec3(278, 278, -800),  vec3(278, 278, 0),  40, 0.0, 10.0},
+    {"smoke",   cornell_smoke,        vec3(278, 278, -800),  vec3(278, 278, 0),  40, 0.0, 10.0},
+    {"final",   final,                vec3(478, 278, -600),  vec3(278, 278, 0),  40, 0.0, 10.0},
+    {"instances", instanced_scene,    vec3(0, 1400, -1900),  vec3(0, 0, -100),   40, 0.0, 10.0, animate_instances},
+    {"mesh",    mesh_scene,           vec3(0, 2.5, -6),      vec3(0, 1, 0),      30, 0.0, 10.0},
+    {"volume",  volume_scene,         vec3(278, 278, -800),  vec3(278, 278, 0),  40, 0.0, 10.0},
+};
+
+// frees the previous scene and builds preset into scene_memory
+hitable* build_scene(const scene_preset& preset, uint64_t scene_seed, bool report)
+{
+    scene_memory.reset();
+    scene_lights.clear();
+    scene_media.clear();
+    scene_materials.clear();
+    scene_textures.clear();
+    spinners.clear();
+    thread_rng().seed(scene_seed, 0); // scene layout and bvh axes
+    bvh_build_seconds = 0;
+    auto start = std::chrono::steady_clock::now();
+    active_arena() = &scene_memory;
+    hitable* world = preset.build();
+    active_arena() = nullptr;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "The build time is:" << elapsed.count() << "s, " << bvh_build_seconds << "s of it in bvh builds" << std::endl;
+    scene_memory.add_external(ARENA_MATERIALS, scene_materials.records.capacity() * sizeof(material_record));
+    scene_memory.add_external(ARENA_TEXTURES, scene_textures.records.capacity() * sizeof(texture_record));
+    if(report) scene_memory.report(std::cerr);
+    return world;
+}
+
+void print_usage(std::ostream& os)
+{
+    os << "usage: rt [options]\n"
+          "  --scene NAME             one of";
+    for(const scene_preset& p : presets) os << " " << p.name;
+    os << "\n"
+          "  --size N                 N x N pixels\n"
+          "  --spp N                  samples per pixel\n"
+          "  --output FILE            .ppm, .png or .pfm, <scene>.ppm by default\n"
+          "  --threads N --tile N     render threads (0 : one per core) and tile size\n"
+          "  --seed N --scene-seed N  sample and scene layout seeds\n"
+          "  --mode NAME              path, packets or wavefront; --packets for packets\n"
+          "  --sampler NAME           random or sobol\n"
+          "  --accel NAME             node, linear, bvh4, bvh8 or motion\n"
+          "  --max-depth N --rr-depth N --no-nee\n"
+          "  --pass-spp N --checkpoint FILE --checkpoint-every S --preview FILE --resume FILE...\n"
+          "  --adaptive THRESHOLD --min-spp N --heatmap FILE\n"
+          "  --frames N|A-B --frame-time S --refit-threshold F\n"
+          "  --mesh FILE --volume FILE --volume-dims NXxNYxNZ\n"
+          "  --bvh-report --bvh-median --memory-report --bench\n";
 }
 
-int main()
+int main(int argc, char** argv)
 {
     int nx = 720;
     int ny = 720;
-    int ns = 30;
-    std::string name = "final2";
-    std::ofstream pic(name + ".ppm");
-    pic << "P3\n" << nx << " " << ny << "\n255\n";
-
-/*
-    vec3 lookfrom(3, 3, 2);
-    vec3 lookat(0, 0, -1);
-    float dist_to_focus = (lookfrom - lookat).length();
-    float aperture = 0.2;
-*/
-/*
-    hitable* world = perlin_two_spheres();
-    vec3 lookfrom(13, 2, 3);
-    vec3 lookat(0, 0, 0);
-    float dist_to_focus = 10.0;
-    float aperture = 0.0;
-    float vfov = 20;
-*/
-
-    hitable* world = final();
-    vec3 lookfrom(478, 278, -600);
-    vec3 lookat(278,278,0);
-    float dist_to_focus = 10.0;
-    float aperture = 0.0;
-    float vfov = 40.0;
-
-/* 
-    hitable* world = cornell_box();
-    vec3 lookfrom(278, 278, -800);
-    vec3 lookat(278, 278, 0);
-    float dist_to_focus = 10.0;
-    float aperture = 0.0;
-    float vfov = 40.0;
-*/
-
-    camera cam(lookfrom, lookat, vec3(0, 1, 0), vfov, float(nx) / float(ny), aperture, dist_to_focus, 0, 1);
-
-    srand((unsigned)time(NULL));
-    
-    for(int j = ny-1; j >= 0; --j)
-        for(int i = 0; i < nx; ++i) {
-            vec3 col(0);
-            for(int s = 0; s < ns; ++s)
+    render_settings settings;
+    std::string scene = "final";
+    std::string output; // .ppm, .png or .pfm, <scene>.ppm by default
+    uint64_t scene_seed = 0;
+    progressive_settings prog;
+    std::vector<std::string> resume; // several checkpoints are merged
+    std::string heatmap;             // samples per pixel image
+    bool bench = false;
+    bool memory_report = false;
+    bool nee = true; // sample the scene's lights directly
+    int first_frame = 0, frame_count = 0; // an animation when frame_count > 0
+    float frame_time = 1.0f / 24;         // seconds per frame, the shutter stays open all of it
+    for(int a = 1; a < argc; ++a)
+    {
+        std::string arg = argv[a];
+        const char* val = a + 1 < argc ? argv[a + 1] : "0";
+        if(arg == "--threads") settings.threads = atoi(val), ++a;
+        else if(arg == "--tile" || arg == "--size")
+        {
+            int v = atoi(val);
+            if(v < 1)
+            {
+                std::cerr << arg << " must be at least 1, not " << val << "\n";
+                return 1;
+            }
+            if(arg == "--tile") settings.tile_size = v;
+            else nx = ny = v;
+            ++a;
+        }
+        else if(arg == "--spp") settings.ns = atoi(val), ++a;
+        else if(arg == "--seed") settings.seed = strtoull(val, nullptr, 10), ++a;
+        else if(arg == "--scene-seed") scene_seed = strtoull(val, nullptr, 10), ++a;
+        else if(arg == "--pass-spp") prog.pass_spp = atoi(val), ++a;
+        else if(arg == "--checkpoint") prog.checkpoint = val, ++a;
+        else if(arg == "--checkpoint-every") prog.checkpoint_seconds = atof(val), ++a;
+        else if(arg == "--preview") prog.preview = val, ++a;
+        else if(arg == "--resume") resume.push_back(val), ++a;
+        else if(arg == "--adaptive") prog.adaptive = true, prog.threshold = atof(val), ++a;
+        else if(arg == "--min-spp") prog.min_spp = atoi(val), ++a;
+        else if(arg == "--heatmap") heatmap = val, ++a;
+        else if(arg == "--scene") scene = val, ++a;
+        else if(arg == "--mesh") mesh_path = val, ++a;
+        else if(arg == "--volume") volume_path = val, ++a;
+        else if(arg == "--volume-dims")
+        {
+            if(sscanf(val, "%dx%dx%d", &volume_dims[0], &volume_dims[1], &volume_dims[2]) != 3)
+                std::cerr << "volume dimensions are NXxNYxNZ, not " << val << "\n";
+            ++a;
+        }
+        else if(arg == "--output") output = val, ++a;
+        else if(arg == "--bvh-report") bvh_report = true;
+        else if(arg == "--bvh-median") bvh_median_split = true;
+        else if(arg == "--memory-report") memory_report = true;
+        else if(arg == "--bench") bench = true;
+        else if(arg == "--packets") settings.mode = MODE_PACKETS;
+        else if(arg == "--max-depth") settings.path.max_depth = atoi(val), ++a;
+        else if(arg == "--rr-depth") settings.path.rr_depth = atoi(val), ++a;
+        else if(arg == "--no-nee") nee = false;
+        else if(arg == "--frames")
+        {
+            // "a-b" renders frames a to b, "n" frames 0 to n-1
+            int first, last, end = 0;
+            size_t len = strlen(val);
+            if(sscanf(val, "%d-%d%n", &first, &last, &end) == 2 && size_t(end) == len && first >= 0 && last >= first)
+                first_frame = first, frame_count = last - first + 1;
+            else if(sscanf(val, "%d%n", &last, &end) == 1 && size_t(end) == len && last >= 1)
+                first_frame = 0, frame_count = last;
+            else
+            {
+                std::cerr << "frames are N or A-B with 0 <= A <= B, not " << val << "\n";
+                return 1;
+            }
+            ++a;
+        }
+        else if(arg == "--frame-time") frame_time = atof(val), ++a;
+        else if(arg == "--refit-threshold") bvh_refit_threshold = atof(val), ++a;
+        else if(arg == "--mode")
+        {
+            if(!parse_render_mode(val, settings.mode))
+            {
+                std::cerr << "unknown render mode " << val << ", one of:";
+                for(const char* name : render_mode_names) std::cerr << " " << name;
+                std::cerr << "\n";
+                return 1;
+            }
+            ++a;
+        }
+        else if(arg == "--sampler")
+        {
+            if(!parse_sampler(val, settings.sampling))
+            {
+                std::cerr << "unknown sampler " << val << ", one of:";
+                for(const char* name : sampler_names) std::cerr << " " << name;
+                std::cerr << "\n";
+                return 1;
+            }
+            ++a;
+        }
+        else if(arg == "--accel")
+        {
+            if(!parse_accel(val))
             {
-                float u = float(i + random()) / float(nx);
-                float v = float(j + random()) / float(ny);
-                ray r = cam.get_ray(u, v);
-                col += color(r, world, 0);
+                std::cerr << "unknown acceleration structure " << val << ", one of:";
+                for(const char* name : accel_names) std::cerr << " " << name;
+                std::cerr << "\n";
+                return 1;
             }
-            col /= float(ns);
-            col = vec3(sqrt(col[0]), sqrt(col[1]), sqrt(col[2])); //gamma correction
+            ++a;
+        }
+        else if(arg == "--help")
+        {
+            print_usage(std::cout);
+            return 0;
+        }
+        else
+        {
+            std::cerr << "unknown option " << arg << "\n";
+            print_usage(std::cerr);
+            return 1;
+        }
+    }
+    prog.target_spp = settings.ns;
+    bvh_build_threads = settings.threads;
+
+    accum_buffer acc(nx, ny);
+    acc.seed = settings.seed;
+    acc.scene_seed = scene_seed;
+    acc.scene = scene;
+    std::vector<uint64_t> merged_seeds;
+    for(size_t k = 0; k < resume.size(); ++k)
+    {
+        accum_buffer part;
+        if(!load_checkpoint(resume[k], part))
+        {
+            std::cerr << "could not read checkpoint " << resume[k] << "\n";
+            return 1;
+        }
+        // runs with the same seed draw the same samples, merging them would count them twice
+        for(size_t m = 0; m < merged_seeds.size(); ++m)
+            if(part.seed == merged_seeds[m])
+            {
+                std::cerr << resume[k] << " has the same seed as " << resume[m] << ", its samples are duplicates\n";
+                return 1;
+            }
+        merged_seeds.push_back(part.seed);
+        if(k == 0)
+            acc = std::move(part);
+        else {
+            if(!acc.merge(part))
+            {
+                std::cerr << resume[k] << " does not match the size or scene of " << resume[0] << "\n";
+                return 1;
+            }
+        }
+    }
+    nx = acc.nx;
+    ny = acc.ny;
+    scene = acc.scene;
+    scene_seed = acc.scene_seed;
+
+    const scene_preset* preset = nullptr;
+    for(const scene_preset& p : presets)
+        if(scene == p.name) preset = &p;
+    if(!preset)
+    {
+        std::cerr << "unknown scene " << scene << ", one of:";
+        for(const scene_preset& p : presets) std::cerr << " " << p.name;
+        std::cerr << "\n";
+        return 1;
+    }
 
-            int ir = int(255.99 * col.e[0]) > 255 ? 255 : int(255.99 * col.e[0]);
-            int ig = int(255.99 * col.e[1]) > 255 ? 255 : int(255.99 * col.e[1]);
-            int ib = int(255.99 * col.e[2]) > 255 ? 255 : int(255.99 * col.e[2]);
+    camera cam(preset->lookfrom, preset->lookat, vec3(0, 1, 0), preset->vfov, float(nx) / float(ny),
+               preset->aperture, preset->dist_to_focus, 0, 1);
 
-            pic << ir << " " << ig << " " << ib << "\n";
+    if(bench)
+    {
+        // same scene under every acceleration structure
+        for(int i = 0; i <= ACCEL_MOTION_BVH; ++i)
+        {
+            accel = accel_type(i);
+            std::cout << accel_names[i] << "\n";
+            hitable* world = build_scene(*preset, scene_seed, memory_report);
+            bench_result primary, bounce, shadow;
+            bench_traversal(cam, world, nx, ny, primary, bounce, shadow);
+            print_bench(std::cout, "  camera", primary);
+            print_bench(std::cout, "  bounce", bounce);
+            print_bench(std::cout, "  shadow", shadow);
+            print_bench(std::cout, "  packet", bench_packets(cam, world, nx, ny));
         }
+        return 0;
+    }
+
+    if(output.empty()) output = std::string(preset->name) + ".ppm";
+
+    hitable* world = build_scene(*preset, scene_seed, memory_report);
+    if(nee && !scene_lights.empty()) settings.path.lights = &scene_lights;
+    if(!scene_media.empty()) settings.path.media = &scene_media;
+
+    if(frame_count > 0)
+    {
+        // the scene is built once. every frame moves it to its time, refits
+        // the hierarchies for its shutter (rebuilding the ones that degraded)
+        // and renders into <output>_<frame>.<ext>, checkpointing to
+        // <checkpoint>_<frame>.<ext>
+        if(!resume.empty()) std::cerr << "--resume is ignored for animations\n";
+        size_t dot = output.rfind('.');
+        std::string base = output.substr(0, dot);
+        std::string ext = dot == std::string::npos ? ".ppm" : output.substr(dot);
+        image_writer writer;
+        for(int f = first_frame; f < first_frame + frame_count; ++f)
+        {
+            float t0 = f * frame_time, t1 = t0 + frame_time;
+            auto start = std::chrono::steady_clock::now();
+            bvh_rebuilds = 0;
+            active_arena() = &scene_memory;
+            if(preset->animate) preset->animate(t0);
+            world->refit(t0, t1);
+            active_arena() = nullptr;
+            std::chrono::duration<double> refit = std::chrono::steady_clock::now() - start;
+
+            camera frame_cam(preset->lookfrom, preset->lookat, vec3(0, 1, 0), preset->vfov, float(nx) / float(ny),
+                             preset->aperture, preset->dist_to_focus, t0, t1);
+            accum_buffer frame(nx, ny);
+            frame.seed = settings.seed;
+            frame.scene_seed = scene_seed;
+            frame.scene = scene;
+            char suffix[16];
+            snprintf(suffix, sizeof(suffix), "_%04d", f);
+            // a frame's samples cover only its shutter, so each gets its own checkpoint
+            progressive_settings frame_prog = prog;
+            if(!prog.checkpoint.empty())
+            {
+                size_t cdot = prog.checkpoint.rfind('.');
+                frame_prog.checkpoint = prog.checkpoint.substr(0, cdot) + suffix
+                                        + (cdot == std::string::npos ? "" : prog.checkpoint.substr(cdot));
+            }
+            render_stats stats;
+            render_progressive(frame_cam, world, settings, frame_prog, frame, &writer, &stats);
+            framebuffer fb(nx, ny);
+            frame.resolve(fb);
+            writer.submit(fb, base + suffix + ext);
+            std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+            std::cout << "frame " << f << ": refit " << refit.count() * 1e3 << "ms, " << bvh_rebuilds
+                      << " rebuilds, render " << elapsed.count() - refit.count() << "s" << std::endl;
+        }
+        return 0;
+    }
+
+    auto start = std::chrono::steady_clock::now();
+    render_stats stats;
+    image_writer writer;
+    render_progressive(cam, world, settings, prog, acc, &writer, &stats);
+    framebuffer fb(nx, ny);
+    acc.resolve(fb);
+    writer.submit(fb, output);
+    if(!heatmap.empty())
+    {
+        framebuffer hm(nx, ny);
+        sample_heatmap(acc, prog.adaptive ? prog.min_spp : 0, prog.target_spp, hm);
+        writer.submit(hm, heatmap);
+    }
 
-    std::cout << "The running time is:" << (double)clock() /CLOCKS_PER_SEC<< "s" << std::endl;
+    std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+    std::cout << "The running time is:" << elapsed.count() << "s" << std::endl;
+    uint64_t samples = 0;
+    for(uint32_t c : acc.count) samples += c;
+    std::cout << double(samples) / acc.count.size() << " spp on average" << std::endl;
+    if(stats.paths)
+        std::cout << stats.paths / stats.seconds * 1e-6 << " Mpaths/s, "
+                  << double(stats.segments) / stats.paths << " rays/path" << std::endl;
 }
\ No newline at end of file
@@ -2,18 +2,9 @@
 #define MATERIAL_H
 
 #include "hitable.h"
-#include "rand.h"
+#include "sampler.h"
 #include "texture.h"
-
-class material 
-{
-public:
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const = 0;
-    virtual vec3 emitted(float u, float v, const vec3& p) const 
-    {
-        return vec3(0);
-    }
-};
+#include <vector>
 
 // reflect and refract ---------------------------------------------------------------------------------------------
 inline vec3 reflect(const vec3& v, const vec3& n)
@@ -34,59 +25,152 @@ inline bool refract(const vec3& v, const vec3& n, float ni_over_nt, vec3& refrac
     else return false;
 }
 
-//lambertian-------------------------------------------------------------------------------------------------------------
-class lambertian : public material
+//schlick-----------------------------------------------------------------------------------------------------------
+inline float schlick(float cosine, float ref_idx) //cosine : in_cosine
+{
+    float r0 = (1 - ref_idx) / (1 + ref_idx);
+    r0 = r0 * r0;
+    return r0 + (1 - r0) * pow(1 - cosine, 5);
+}
+
+//material table----------------------------------------------------------------------------------------------------
+// every material of the scene as a tagged record in one array, evaluated with
+// a switch. a constant albedo or emission is folded into color, so the common
+// lambertian does not look up a texture at all.
+enum material_kind
+{
+    MAT_LAMBERTIAN,
+    MAT_METAL,
+    MAT_DIELECTRIC,
+    MAT_DIFFUSE_LIGHT,
+    MAT_ISOTROPIC
+};
+
+struct material_record
+{
+    material_kind kind;
+    int tex = -1;       // albedo or emission texture, -1 when folded into color
+    vec3 color = vec3(0);
+    float param = 0;    // metal : fuzz, dielectric : refractive index
+
+    bool emits() const { return kind == MAT_DIFFUSE_LIGHT; }
+    vec3 albedo(const hit_record& rec) const { return tex < 0 ? color : texture_value(tex, rec.u, rec.v, rec.p); }
+};
+
+class material_table
 {
 public:
-    lambertian(texture* a) : albedo(a) {}
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    int add(const material_record& m)
     {
-        vec3 target = rec.p + rec.normal + random_in_unit_sphere();
-        scattered = ray(rec.p, target - rec.p, r_in.time());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
-        return true;
+        records.push_back(m);
+        return int(records.size()) - 1;
     }
-    texture* albedo;
+    const material_record& operator[](int id) const { return records[id]; }
+    void clear() { records.clear(); }
+
+    std::vector<material_record> records;
+};
+
+// materials of the scene being built, cleared with it
+material_table scene_materials;
+
+//materials---------------------------------------------------------------------------------------------------------
+// what the scene functions build and primitives point to; each one only
+// registers its record, found through id
+class material
+{
+public:
+    const material_record& record() const { return scene_materials[id]; }
+    int id = 0;
+protected:
+    void add(material_kind kind, texture* t, float param = 0)
+    {
+        material_record m;
+        m.kind = kind;
+        m.param = param;
+        if(t->is_constant())
+            m.color = scene_textures[t->id].color;
+        else
+            m.tex = t->id;
+        id = scene_materials.add(m);
+    }
+};
+
+class lambertian : public material
+{
+public:
+    lambertian(texture* a) { add(MAT_LAMBERTIAN, a); }
 };
 
-//metal-------------------------------------------------------------------------------------------------------------
 class metal : public material
 {
 public:
-    metal(const vec3& a, float f) : albedo(a) 
+    metal(const vec3& a, float f)
     {
-        fuzz = f < 1 ? f : 1;
+        material_record m;
+        m.kind = MAT_METAL;
+        m.color = a;
+        m.param = f < 1 ? f : 1;
+        id = scene_materials.add(m);
     }
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+};
+
+class dielectric : public material
+{
+public:
+    dielectric(float ri)
     {
-        vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
-        scattered = ray(rec.p, reflected + fuzz * random_in_unit_sphere(), r_in.time());
-        attenuation = albedo;
-        return (dot(scattered.direction(), rec.normal) > 0);
+        material_record m;
+        m.kind = MAT_DIELECTRIC;
+        m.color = vec3(1.0);
+        m.param = ri;
+        id = scene_materials.add(m);
     }
-    vec3 albedo;
-    float fuzz;
 };
 
-//schlick-----------------------------------------------------------------------------------------------------------
-float schlick(float cosine, float ref_idx) //cosine : in_cosine
+class diffuse_light : public material
 {
-    float r0 = (1 - ref_idx) / (1 + ref_idx);
-    r0 = r0 * r0;
-    return r0 + (1 - r0) * pow(1 - cosine, 5);
-}
+public:
+    diffuse_light(texture* a) { add(MAT_DIFFUSE_LIGHT, a); }
+};
 
-//dielectric----------------------------------------------------------------------------------------------------------
-class dielectric : public material
+class isotropic : public material
 {
 public:
-    dielectric(float ri) : ref_idx(ri) {}
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    isotropic(texture* a) { add(MAT_ISOTROPIC, a); }
+};
+
+//evaluation--------------------------------------------------------------------------------------------------------
+inline bool scatter(const material_record& m, const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered, sampler& smp)
+{
+    switch(m.kind)
+    {
+    case MAT_LAMBERTIAN:
     {
+        float s1, s2;
+        smp.get_2d(s1, s2);
+        vec3 d = warp_cosine_hemisphere(s1, s2), u, v;
+        make_basis(rec.normal, u, v);
+        scattered = ray(rec.p, d.x() * u + d.y() * v + d.z() * rec.normal, r_in.time());
+        attenuation = m.albedo(rec);
+        return true;
+    }
+    case MAT_METAL:
+    {
+        vec3 reflected = reflect(unit_vector(r_in.direction()), rec.normal);
+        float s1, s2;
+        smp.get_2d(s1, s2);
+        scattered = ray(rec.p, reflected + m.param * warp_ball(s1, s2, smp.get_1d()), r_in.time());
+        attenuation = m.color;
+        return (dot(scattered.direction(), rec.normal) > 0);
+    }
+    case MAT_DIELECTRIC:
+    {
+        float ref_idx = m.param;
         vec3 outward_normal;
         vec3 reflected = reflect(r_in.direction(), rec.normal);
         float ni_over_nt;
-        attenuation = vec3(1.0);
+        attenuation = m.color;
         vec3 refracted;
         float reflect_prob;
         float cosine;
@@ -110,7 +194,7 @@ public:
             reflect_prob = 1.0;
         }
 
-        if(random() < reflect_prob)
+        if(smp.get_1d() < reflect_prob)
         {
             scattered = ray(rec.p, reflected, r_in.time());
         }
@@ -119,37 +203,58 @@ public:
         }
         return true;
     }
-    float ref_idx;
-};
-
-//diffuse_light----------------------------------------------------------------------------------------------------------
-class diffuse_light : public material
-{
-public:
-    diffuse_light() = default;
-    diffuse_light(texture* a) : emit(a) {}
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    case MAT_ISOTROPIC:
     {
+        float s1, s2;
+        smp.get_2d(s1, s2);
+        scattered = ray(rec.p, warp_sphere(s1, s2), r_in.time());
+        attenuation = m.albedo(rec);
+        return true;
+    }
+    default:
         return false;
     }
-    virtual vec3 emitted(float u, float v, const vec3& p) const
+}
+
+inline vec3 emission(const material_record& m, float u, float v, const vec3& p)
+{
+    if(!m.emits()) return vec3(0);
+    return m.tex < 0 ? m.color : texture_value(m.tex, u, v, p);
+}
+
+// for next event estimation and MIS, 0 for specular materials and lights:
+// scattering_pdf is the density of scatter() choosing direction d, and
+// scatter_value the attenuation it would weight d with times that density
+// (the brdf times the cosine for surfaces).
+inline float scattering_pdf(const material_record& m, const hit_record& rec, const vec3& d)
+{
+    switch(m.kind)
     {
-        return emit-> value(u, v, p);
+    case MAT_LAMBERTIAN:
+    {
+        float cosine = dot(rec.normal, unit_vector(d));
+        return cosine > 0 ? cosine / M_PI : 0;
     }
-    texture* emit;
-};
+    case MAT_ISOTROPIC:
+        return 1 / (4 * M_PI);
+    default:
+        return 0;
+    }
+}
 
-//isotropic----------------------------------------------------------------------------------------------------------
-class isotropic : public material
+inline vec3 scatter_value(const material_record& m, const hit_record& rec, const vec3& d)
 {
-public:
-    isotropic(texture* a) : albedo(a) {}
-    virtual bool scatter(const ray& r_in, const hit_record& rec, vec3& attenuation, ray& scattered) const
+    switch(m.kind)
     {
-        scattered = ray(rec.p, random_in_unit_sphere());
-        attenuation = albedo->value(rec.u, rec.v, rec.p);
-        return true;
-    }    
-    texture* albedo;
-};
-#endif
\ No newline at end of file
+    case MAT_LAMBERTIAN:
+    {
+        float pdf = scattering_pdf(m, rec, d);
+        return pdf > 0 ? m.albedo(rec) * pdf : vec3(0);
+    }
+    case MAT_ISOTROPIC:
+        return m.albedo(rec) / (4 * M_PI);
+    default:
+        return vec3(0);
+    }
+}
+#endif
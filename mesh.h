@@ -0,0 +1,198 @@
+// indexed triangle meshes
+#ifndef MESH_H
+#define MESH_H
+
+#include "hitable.h"
+#include "material.h"
+#include "affine.h"
+#include <math.h>
+#include <float.h>
+#include <vector>
+
+class mesh_triangle;
+
+// vertex attributes in separate arrays (structure of arrays), shared by the
+// triangles through indices
+class triangle_mesh
+{
+public:
+    int vertex_count() const { return int(px.size()); }
+    int triangle_count() const { return int(indices.size() / 3); }
+    bool has_normals() const { return !nx.empty(); }
+    bool has_uvs() const { return !tu.empty(); }
+    vec3 position(int i) const { return vec3(px[i], py[i], pz[i]); }
+    vec3 normal(int i) const { return vec3(nx[i], ny[i], nz[i]); }
+
+    void add_vertex(const vec3& p)
+    {
+        px.push_back(p[0]); py.push_back(p[1]); pz.push_back(p[2]);
+    }
+    void add_triangle(int a, int b, int c)
+    {
+        indices.push_back(a); indices.push_back(b); indices.push_back(c);
+    }
+
+    aabb bounds() const
+    {
+        aabb b = empty_box();
+        for(int i = 0; i < vertex_count(); ++i)
+            b = surrounding_box(b, aabb(position(i), position(i)));
+        return b;
+    }
+    // bakes xf into the positions and normals
+    void transform(const affine& xf)
+    {
+        for(int i = 0; i < vertex_count(); ++i)
+        {
+            vec3 p = xf.point(position(i));
+            px[i] = p[0]; py[i] = p[1]; pz[i] = p[2];
+        }
+        if(!has_normals()) return;
+        affine inv = xf.inverse();
+        for(int i = 0; i < vertex_count(); ++i)
+        {
+            vec3 n = unit_vector(inv.transposed_vector(normal(i)));
+            nx[i] = n[0]; ny[i] = n[1]; nz[i] = n[2];
+        }
+    }
+
+    // of the arrays, including the triangles made for the bvh
+    size_t memory_bytes() const;
+    // one hitable per triangle, for make_bvh. list must hold triangle_count() entries.
+    void make_triangles(hitable** list);
+
+    std::vector<float> px, py, pz;
+    std::vector<float> nx, ny, nz; // shading normals, empty when the mesh has none
+    std::vector<float> tu, tv;     // texture coordinates, empty when the mesh has none
+    std::vector<int> indices;      // three per triangle, counter clockwise seen from the front
+    material* mat = nullptr;
+    std::vector<mesh_triangle> triangles;
+};
+
+//watertight intersection---------------------------------------------------------------------
+// Woop, Benthin and Wald 2013: the vertices are sheared into a space where the
+// ray runs along +z from the origin, and the 2d edge tests are evaluated the
+// same way for triangles sharing an edge, so rays cannot slip through.
+// weights are the barycentrics of a, b and c.
+inline bool watertight_hit(const ray& r, const vec3& a, const vec3& b, const vec3& c,
+                           float t_min, float t_max, float& t, vec3& weights)
+{
+    const vec3& d = r.direction();
+    int kz = fabsf(d[0]) > fabsf(d[1]) ? (fabsf(d[0]) > fabsf(d[2]) ? 0 : 2) : (fabsf(d[1]) > fabsf(d[2]) ? 1 : 2);
+    int kx = kz == 2 ? 0 : kz + 1;
+    int ky = kx == 2 ? 0 : kx + 1;
+    if(d[kz] < 0) std::swap(kx, ky); // keeps the winding
+    float sz = 1.0f / d[kz];
+    float sx = d[kx] * sz, sy = d[ky] * sz;
+
+    vec3 A = a - r.origin(), B = b - r.origin(), C = c - r.origin();
+    float ax = A[kx] - sx * A[kz], ay = A[ky] - sy * A[kz];
+    float bx = B[kx] - sx * B[kz], by = B[ky] - sy * B[kz];
+    float cx = C[kx] - sx * C[kz], cy = C[ky] - sy * C[kz];
+
+    // the edge functions of a shared edge must come out exactly negated. in
+    // double the products are exact, so neither rounding nor a contraction
+    // into fma can break that.
+    float u = float(double(cx) * by - double(cy) * bx);
+    float v = float(double(ax) * cy - double(ay) * cx);
+    float w = float(double(bx) * ay - double(by) * ax);
+    if((u < 0 || v < 0 || w < 0) && (u > 0 || v > 0 || w > 0)) return false;
+    float det = u + v + w;
+    if(det == 0) return false;
+
+    float T = sz * (u * A[kz] + v * B[kz] + w * C[kz]);
+    float inv_det = 1.0f / det;
+    t = T * inv_det;
+    if(t <= t_min || t >= t_max) return false;
+    weights = vec3(u * inv_det, v * inv_det, w * inv_det);
+    return true;
+}
+
+//triangle------------------------------------------------------------------------------------
+class mesh_triangle : public hitable
+{
+public:
+    mesh_triangle() = default;
+    mesh_triangle(const triangle_mesh* m, int i) : mesh(m), first(3 * i) {}
+
+    void vertices(vec3& a, vec3& b, vec3& c) const
+    {
+        const int* idx = &mesh->indices[first];
+        a = mesh->position(idx[0]);
+        b = mesh->position(idx[1]);
+        c = mesh->position(idx[2]);
+    }
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+    {
+        vec3 a, b, c, weights;
+        float t;
+        vertices(a, b, c);
+        if(!watertight_hit(r, a, b, c, t_min, t_max, t, weights)) return false;
+        record_hit(rec, t, this);
+        return true;
+    }
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        vec3 a, b, c, weights;
+        float t;
+        vertices(a, b, c);
+        return watertight_hit(r, a, b, c, t_min, t_max, t, weights);
+    }
+    // the barycentrics are recomputed here rather than kept by every hit()
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        const int* idx = &mesh->indices[first];
+        vec3 a, b, c, w;
+        float t;
+        vertices(a, b, c);
+        watertight_hit(r, a, b, c, -FLT_MAX, FLT_MAX, t, w);
+        rec.p = r.point_at_parameter(rec.t);
+        if(mesh->has_normals())
+            rec.normal = unit_vector(w[0] * mesh->normal(idx[0]) + w[1] * mesh->normal(idx[1]) + w[2] * mesh->normal(idx[2]));
+        else
+            rec.normal = unit_vector(cross(b - a, c - a));
+        if(mesh->has_uvs())
+        {
+            rec.u = w[0] * mesh->tu[idx[0]] + w[1] * mesh->tu[idx[1]] + w[2] * mesh->tu[idx[2]];
+            rec.v = w[0] * mesh->tv[idx[0]] + w[1] * mesh->tv[idx[1]] + w[2] * mesh->tv[idx[2]];
+        }else {
+            rec.u = w[1];
+            rec.v = w[2];
+        }
+        rec.mat_ptr = mesh->mat;
+    }
+    virtual bool bounding_box(float t0, float t1, aabb& box) const
+    {
+        vec3 a, b, c;
+        vertices(a, b, c);
+        vec3 lo, hi;
+        for(int i = 0; i < 3; ++i)
+        {
+            // padded like the rects, a flat box would be missed by the slab test
+            lo[i] = fmin(a[i], fmin(b[i], c[i])) - 0.0001f;
+            hi[i] = fmax(a[i], fmax(b[i], c[i])) + 0.0001f;
+        }
+        box = aabb(lo, hi);
+        return true;
+    }
+    const triangle_mesh* mesh;
+    int first; // of the triangle's three indices
+};
+
+inline size_t triangle_mesh::memory_bytes() const
+{
+    return (px.capacity() * 3 + nx.capacity() * 3 + tu.capacity() * 2) * sizeof(float)
+           + indices.capacity() * sizeof(int) + triangles.capacity() * sizeof(mesh_triangle);
+}
+
+inline void triangle_mesh::make_triangles(hitable** list)
+{
+    triangles.assign(triangle_count(), mesh_triangle());
+    for(int i = 0; i < triangle_count(); ++i)
+    {
+        triangles[i] = mesh_triangle(this, i);
+        list[i] = &triangles[i];
+    }
+}
+
+#endif
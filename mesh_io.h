@@ -0,0 +1,563 @@
+// wavefront obj and stanford ply loaders
+#ifndef MESH_IO_H
+#define MESH_IO_H
+
+#include "mesh.h"
+#include "thread_pool.h"
+#include <limits.h>
+#include <stdint.h>
+#include <string.h>
+#include <charconv>
+#include <fstream>
+#include <iostream>
+#include <sstream>
+#include <string>
+#include <unordered_map>
+#include <vector>
+
+inline bool read_file(const std::string& path, std::string& data)
+{
+    std::ifstream f(path, std::ios::binary | std::ios::ate);
+    if(!f) return false;
+    data.resize(size_t(f.tellg()));
+    f.seekg(0);
+    f.read(&data[0], data.size());
+    return bool(f);
+}
+
+//obj-----------------------------------------------------------------------------------------
+// v, vt, vn and f lines; other statements are ignored. polygons are fanned into
+// triangles. the file is cut into chunks at line breaks that are parsed in
+// parallel, then joined.
+struct obj_corner
+{
+    int v, vt, vn; // 0 based, -1 when absent. negative relative indices are
+                   // resolved against the chunk first, see obj_chunk::resolve
+};
+
+inline bool operator==(const obj_corner& a, const obj_corner& b)
+{
+    return a.v == b.v && a.vt == b.vt && a.vn == b.vn;
+}
+
+struct obj_corner_hash
+{
+    size_t operator()(const obj_corner& k) const
+    {
+        return hash64((uint64_t(uint32_t(k.v)) << 32 | uint32_t(k.vt)) ^ uint64_t(uint32_t(k.vn)) * 0x9e3779b97f4a7c15ull);
+    }
+};
+
+struct obj_chunk
+{
+    std::vector<float> v, vt, vn; // 3, 2 and 3 floats per entry
+    std::vector<obj_corner> corners; // three per triangle
+    bool ok = true;
+
+    // a relative index -k counts back from the entries parsed so far, but the
+    // global offset of this chunk is only known once every chunk is parsed: the
+    // position within the chunk (negative when it reaches into an earlier one)
+    // is stored biased below -1 and fixed up by resolve()
+    static const int bias = 1 << 30;
+    static int relative(int local_count, int k) { return local_count + k - bias; }
+    static int resolve(int i, int offset) { return i < -1 ? i + bias + offset : i; }
+};
+
+inline const char* obj_skip_space(const char* p, const char* end)
+{
+    while(p < end && (*p == ' ' || *p == '\t' || *p == '\r')) ++p;
+    return p;
+}
+
+inline const char* obj_float(const char* p, const char* end, float& x, bool& ok)
+{
+    p = obj_skip_space(p, end);
+    if(p < end && *p == '+') ++p;
+    auto res = std::from_chars(p, end, x);
+    if(res.ec != std::errc()) ok = false;
+    return res.ptr;
+}
+
+inline const char* obj_int(const char* p, const char* end, int& x, bool& present, bool& ok)
+{
+    bool neg = p < end && *p == '-';
+    if(neg) ++p;
+    present = p < end && *p >= '0' && *p <= '9';
+    int64_t n = 0;
+    while(p < end && *p >= '0' && *p <= '9')
+    {
+        n = n * 10 + (*p++ - '0');
+        if(n > INT_MAX)
+        {
+            present = ok = false;
+            n = 0;
+            while(p < end && *p >= '0' && *p <= '9') ++p;
+        }
+    }
+    x = int(neg ? -n : n);
+    return p;
+}
+
+// 1 based or negative obj index to the encoding of obj_chunk, -1 when absent
+inline int obj_index(int i, bool present, int local_count, bool& ok)
+{
+    if(!present) return -1;
+    if(i > 0) return i - 1;
+    if(i < 0) return obj_chunk::relative(local_count, i);
+    ok = false;
+    return -1;
+}
+
+inline void parse_obj_chunk(const char* p, const char* end, obj_chunk& c)
+{
+    std::vector<obj_corner> poly;
+    while(p < end)
+    {
+        const char* eol = (const char*)memchr(p, '\n', end - p);
+        if(!eol) eol = end;
+        p = obj_skip_space(p, eol);
+        if(p + 1 < eol && p[0] == 'v' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            float x, y, z;
+            p = obj_float(p + 1, eol, x, c.ok);
+            p = obj_float(p, eol, y, c.ok);
+            p = obj_float(p, eol, z, c.ok);
+            c.v.push_back(x); c.v.push_back(y); c.v.push_back(z);
+        }
+        else if(p + 2 < eol && p[0] == 'v' && p[1] == 't' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            float u, v = 0;
+            p = obj_float(p + 2, eol, u, c.ok);
+            if(obj_skip_space(p, eol) < eol) p = obj_float(p, eol, v, c.ok);
+            c.vt.push_back(u); c.vt.push_back(v);
+        }
+        else if(p + 2 < eol && p[0] == 'v' && p[1] == 'n' && (p[2] == ' ' || p[2] == '\t'))
+        {
+            float x, y, z;
+            p = obj_float(p + 2, eol, x, c.ok);
+            p = obj_float(p, eol, y, c.ok);
+            p = obj_float(p, eol, z, c.ok);
+            c.vn.push_back(x); c.vn.push_back(y); c.vn.push_back(z);
+        }
+        else if(p + 1 < eol && p[0] == 'f' && (p[1] == ' ' || p[1] == '\t'))
+        {
+            poly.clear();
+            p = obj_skip_space(p + 1, eol);
+            while(p < eol)
+            {
+                // v, v/vt, v//vn or v/vt/vn
+                int i;
+                bool present;
+                obj_corner k;
+                p = obj_int(p, eol, i, present, c.ok);
+                if(!present) { c.ok = false; break; }
+                k.v = obj_index(i, present, int(c.v.size() / 3), c.ok);
+                k.vt = k.vn = -1;
+                if(p < eol && *p == '/')
+                {
+                    p = obj_int(p + 1, eol, i, present, c.ok);
+                    k.vt = obj_index(i, present, int(c.vt.size() / 2), c.ok);
+                    if(p < eol && *p == '/')
+                    {
+                        p = obj_int(p + 1, eol, i, present, c.ok);
+                        k.vn = obj_index(i, present, int(c.vn.size() / 3), c.ok);
+                    }
+                }
+                poly.push_back(k);
+                p = obj_skip_space(p, eol);
+            }
+            for(size_t j = 2; j < poly.size(); ++j)
+            {
+                c.corners.push_back(poly[0]);
+                c.corners.push_back(poly[j - 1]);
+                c.corners.push_back(poly[j]);
+            }
+        }
+        p = eol + 1;
+    }
+}
+
+inline bool load_obj(const std::string& path, triangle_mesh& mesh, int threads = 0)
+{
+    std::string data;
+    if(!read_file(path, data))
+    {
+        std::cerr << "could not read " << path << "\n";
+        return false;
+    }
+
+    // about 4MB per chunk, cut after a line break
+    size_t chunk_size = size_t(1) << 22;
+    std::vector<size_t> cuts(1, 0);
+    while(cuts.back() < data.size())
+    {
+        size_t c = std::min(data.size(), cuts.back() + chunk_size);
+        while(c < data.size() && data[c - 1] != '\n') ++c;
+        cuts.push_back(c);
+    }
+    std::vector<obj_chunk> chunks(cuts.size() - 1);
+    {
+        thread_pool pool(threads);
+        for(size_t i = 0; i < chunks.size(); ++i)
+            pool.submit([&, i] { parse_obj_chunk(data.data() + cuts[i], data.data() + cuts[i + 1], chunks[i]); });
+        pool.wait();
+    }
+
+    // joins the chunks, fixing up indices with the entries before each chunk
+    std::vector<float> v, vt, vn;
+    std::vector<obj_corner> corners;
+    bool with_vt = false, with_vn = false;
+    for(obj_chunk& c : chunks)
+    {
+        if(!c.ok)
+        {
+            std::cerr << path << ": malformed line\n";
+            return false;
+        }
+        int ov = int(v.size() / 3), ot = int(vt.size() / 2), on = int(vn.size() / 3);
+        for(obj_corner k : c.corners)
+        {
+            k.v = obj_chunk::resolve(k.v, ov);
+            k.vt = obj_chunk::resolve(k.vt, ot);
+            k.vn = obj_chunk::resolve(k.vn, on);
+            with_vt |= k.vt >= 0;
+            with_vn |= k.vn >= 0;
+            corners.push_back(k);
+        }
+        v.insert(v.end(), c.v.begin(), c.v.end());
+        vt.insert(vt.end(), c.vt.begin(), c.vt.end());
+        vn.insert(vn.end(), c.vn.begin(), c.vn.end());
+        c = obj_chunk();
+    }
+    int nv = int(v.size() / 3), nt = int(vt.size() / 2), nn = int(vn.size() / 3);
+    for(const obj_corner& k : corners)
+        if(k.v < 0 || k.v >= nv || k.vt >= nt || k.vn >= nn || (with_vt && k.vt < 0) || (with_vn && k.vn < 0))
+        {
+            std::cerr << path << ": face index out of range or missing attribute\n";
+            return false;
+        }
+    if(corners.empty())
+    {
+        std::cerr << path << ": no faces\n";
+        return false;
+    }
+
+    mesh = triangle_mesh();
+    if(!with_vt && !with_vn)
+    {
+        // positions only: the obj indices are the mesh's
+        mesh.px.resize(nv); mesh.py.resize(nv); mesh.pz.resize(nv);
+        for(int i = 0; i < nv; ++i)
+        {
+            mesh.px[i] = v[3 * i]; mesh.py[i] = v[3 * i + 1]; mesh.pz[i] = v[3 * i + 2];
+        }
+        mesh.indices.resize(corners.size());
+        for(size_t i = 0; i < corners.size(); ++i)
+            mesh.indices[i] = corners[i].v;
+        return true;
+    }
+
+    // obj indexes each attribute on its own: every distinct combination
+    // becomes one mesh vertex
+    std::unordered_map<obj_corner, int, obj_corner_hash> remap;
+    remap.reserve(nv * 2);
+    mesh.indices.resize(corners.size());
+    for(size_t i = 0; i < corners.size(); ++i)
+    {
+        const obj_corner& k = corners[i];
+        auto it = remap.find(k);
+        if(it != remap.end())
+        {
+            mesh.indices[i] = it->second;
+            continue;
+        }
+        int n = mesh.vertex_count();
+        remap.emplace(k, n);
+        mesh.add_vertex(vec3(v[3 * k.v], v[3 * k.v + 1], v[3 * k.v + 2]));
+        if(with_vt)
+        {
+            mesh.tu.push_back(vt[2 * k.vt]);
+            mesh.tv.push_back(vt[2 * k.vt + 1]);
+        }
+        if(with_vn)
+        {
+            vec3 n3 = unit_vector(vec3(vn[3 * k.vn], vn[3 * k.vn + 1], vn[3 * k.vn + 2]));
+            mesh.nx.push_back(n3[0]); mesh.ny.push_back(n3[1]); mesh.nz.push_back(n3[2]);
+        }
+        mesh.indices[i] = n;
+    }
+    return true;
+}
+
+//ply-----------------------------------------------------------------------------------------
+// ascii and binary little endian files with a vertex element (x y z, optional
+// nx ny nz and u v or s t) and a face element with a vertex_indices list.
+// other elements are skipped when their size is fixed.
+struct ply_property
+{
+    std::string name;
+    int type = 0;       // size in bytes, negative for signed, 0 when unknown
+    bool is_float = false;
+    bool is_list = false;
+    int count_type = 0; // of a list's length
+};
+
+struct ply_element
+{
+    std::string name;
+    int64_t count = 0;
+    std::vector<ply_property> props;
+};
+
+inline bool ply_type(const std::string& t, int& size, bool& is_float)
+{
+    static const struct { const char* name; int size; bool is_float; } types[] = {
+        {"char", -1, false}, {"int8", -1, false}, {"uchar", 1, false}, {"uint8", 1, false},
+        {"short", -2, false}, {"int16", -2, false}, {"ushort", 2, false}, {"uint16", 2, false},
+        {"int", -4, false}, {"int32", -4, false}, {"uint", 4, false}, {"uint32", 4, false},
+        {"float", 4, true}, {"float32", 4, true}, {"double", 8, true}, {"float64", 8, true}};
+    for(const auto& k : types)
+        if(t == k.name)
+        {
+            size = k.size;
+            is_float = k.is_float;
+            return true;
+        }
+    return false;
+}
+
+// reads one binary value of the type into x and advances p, false when the
+// data ends before it
+inline bool ply_binary(const char*& p, const char* end, int type, bool is_float, double& x)
+{
+    int size = type < 0 ? -type : type;
+    if(end - p < size) return false;
+    x = 0;
+    if(is_float)
+    {
+        if(type == 4) { float f; memcpy(&f, p, 4); x = f; }
+        else memcpy(&x, p, 8);
+    }else {
+        switch(type)
+        {
+        case -1: { int8_t i; memcpy(&i, p, 1); x = i; break; }
+        case 1: { uint8_t i; memcpy(&i, p, 1); x = i; break; }
+        case -2: { int16_t i; memcpy(&i, p, 2); x = i; break; }
+        case 2: { uint16_t i; memcpy(&i, p, 2); x = i; break; }
+        case -4: { int32_t i; memcpy(&i, p, 4); x = i; break; }
+        case 4: { uint32_t i; memcpy(&i, p, 4); x = i; break; }
+        }
+    }
+    p += size;
+    return true;
+}
+
+inline bool load_ply(const std::string& path, triangle_mesh& mesh)
+{
+    std::string data;
+    if(!read_file(path, data))
+    {
+        std::cerr << "could not read " << path << "\n";
+        return false;
+    }
+    size_t header_end = data.find("end_header");
+    if(data.compare(0, 3, "ply") != 0 || header_end == std::string::npos)
+    {
+        std::cerr << path << ": not a ply file\n";
+        return false;
+    }
+    std::istringstream header(data.substr(0, header_end));
+    std::vector<ply_element> elements;
+    std::string line, format;
+    while(std::getline(header, line))
+    {
+        std::istringstream ls(line);
+        std::string word;
+        ls >> word;
+        if(word == "format") ls >> format;
+        else if(word == "element")
+        {
+            elements.emplace_back();
+            ls >> elements.back().name >> elements.back().count;
+        }
+        else if(word == "property" && !elements.empty())
+        {
+            ply_property prop;
+            std::string type;
+            ls >> type;
+            bool count_float;
+            if(type == "list")
+            {
+                std::string count_type;
+                ls >> count_type >> type;
+                prop.is_list = true;
+                if(!ply_type(count_type, prop.count_type, count_float)) prop.count_type = 0;
+            }
+            if(!ply_type(type, prop.type, prop.is_float)) prop.type = 0;
+            ls >> prop.name;
+            elements.back().props.push_back(prop);
+        }
+    }
+    bool ascii = format == "ascii";
+    if(!ascii && format != "binary_little_endian")
+    {
+        std::cerr << path << ": unsupported ply format " << format << "\n";
+        return false;
+    }
+
+    const char* p = data.data() + header_end + strlen("end_header");
+    const char* end = data.data() + data.size();
+    while(p < end && *p != '\n') ++p;
+    if(p < end) ++p;
+
+    mesh = triangle_mesh();
+    bool ok = true;
+    std::vector<int> poly;
+    // one value of prop, from the text or the binary data
+    auto value = [&](int type, bool is_float) -> double {
+        double x = 0;
+        if(!ascii)
+        {
+            if(ok && !ply_binary(p, end, type, is_float, x)) ok = false;
+            return x;
+        }
+        p = obj_skip_space(p, end);
+        while(p < end && *p == '\n') p = obj_skip_space(p + 1, end);
+        auto res = std::from_chars(p, end, x);
+        if(res.ec != std::errc()) ok = false;
+        p = res.ptr;
+        return x;
+    };
+    for(const ply_element& e : elements)
+    {
+        if(!ok) break;
+        int stride = 0; // bytes per binary item, 0 when not fixed
+        for(const ply_property& prop : e.props)
+        {
+            if(prop.type == 0 || (prop.is_list && prop.count_type == 0))
+            {
+                std::cerr << path << ": unknown property type in " << e.name << "\n";
+                return false;
+            }
+            stride = prop.is_list || stride < 0 ? -1 : stride + abs(prop.type);
+        }
+        bool vertex = e.name == "vertex", face = e.name == "face";
+        if(!vertex && !face && !ascii && stride < 0)
+        {
+            std::cerr << path << ": cannot skip element " << e.name << "\n";
+            return false;
+        }
+        if(!vertex && !face && !ascii)
+        {
+            if(e.count < 0 || (stride > 0 && e.count > (end - p) / stride))
+            {
+                ok = false;
+                break;
+            }
+            p += e.count * stride;
+            continue;
+        }
+
+        // columns of the vertex attributes, -1 when absent
+        int col[8];
+        const char* names[8][2] = {{"x", "x"}, {"y", "y"}, {"z", "z"}, {"nx", "nx"}, {"ny", "ny"}, {"nz", "nz"},
+                                   {"u", "s"}, {"v", "t"}};
+        for(int k = 0; k < 8; ++k)
+        {
+            col[k] = -1;
+            for(size_t i = 0; i < e.props.size(); ++i)
+                if(e.props[i].name == names[k][0] || e.props[i].name == names[k][1]
+                   || (k >= 6 && e.props[i].name == std::string("texture_") + names[k][0]))
+                    col[k] = int(i);
+        }
+        if(vertex && (col[0] < 0 || col[1] < 0 || col[2] < 0))
+        {
+            std::cerr << path << ": vertices without positions\n";
+            return false;
+        }
+        bool normals = vertex && col[3] >= 0 && col[4] >= 0 && col[5] >= 0;
+        bool uvs = vertex && col[6] >= 0 && col[7] >= 0;
+
+        double attr[8];
+        for(int64_t n = 0; n < e.count && ok; ++n)
+        {
+            if(p >= end) { ok = false; break; }
+            for(size_t i = 0; i < e.props.size(); ++i)
+            {
+                const ply_property& prop = e.props[i];
+                if(!prop.is_list)
+                {
+                    double x = value(prop.type, prop.is_float);
+                    for(int k = 0; k < 8; ++k)
+                        if(col[k] == int(i)) attr[k] = x;
+                    continue;
+                }
+                // every entry takes at least a byte, so a longer list cannot be in the data
+                bool indices = face && (prop.name == "vertex_indices" || prop.name == "vertex_index");
+                double count = value(prop.count_type, false);
+                if(!ok || !(count >= (indices ? 3 : 0)) || count > double(end - p))
+                {
+                    ok = false;
+                    break;
+                }
+                int len = int(count);
+                poly.clear();
+                for(int j = 0; j < len && ok; ++j)
+                {
+                    double x = value(prop.type, prop.is_float);
+                    if(!indices) continue;
+                    if(!(x >= 0 && x <= INT_MAX)) ok = false;
+                    else poly.push_back(int(x));
+                }
+                if(!ok) break;
+                if(indices)
+                    for(int j = 2; j < len; ++j)
+                        mesh.add_triangle(poly[0], poly[j - 1], poly[j]);
+            }
+            if(!ok) break;
+            if(vertex)
+            {
+                mesh.add_vertex(vec3(attr[0], attr[1], attr[2]));
+                if(normals)
+                {
+                    vec3 nn = unit_vector(vec3(attr[3], attr[4], attr[5]));
+                    mesh.nx.push_back(nn[0]); mesh.ny.push_back(nn[1]); mesh.nz.push_back(nn[2]);
+                }
+                if(uvs)
+                {
+                    mesh.tu.push_back(attr[6]);
+                    mesh.tv.push_back(attr[7]);
+                }
+            }
+        }
+    }
+    if(!ok)
+    {
+        std::cerr << path << ": truncated or malformed data\n";
+        return false;
+    }
+    if(mesh.triangle_count() == 0)
+    {
+        std::cerr << path << ": no faces\n";
+        return false;
+    }
+    for(int i : mesh.indices)
+        if(i < 0 || i >= mesh.vertex_count())
+        {
+            std::cerr << path << ": face index out of range\n";
+            return false;
+        }
+    return true;
+}
+
+// by extension, .obj or .ply
+inline bool load_mesh(const std::string& path, triangle_mesh& mesh, int threads = 0)
+{
+    std::string ext = path.size() > 4 ? path.substr(path.size() - 4) : "";
+    if(ext == ".obj") return load_obj(path, mesh, threads);
+    if(ext == ".ply") return load_ply(path, mesh);
+    std::cerr << "unknown mesh format " << path << "\n";
+    return false;
+}
+
+#endif
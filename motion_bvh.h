@@ -0,0 +1,326 @@
+// motion bvh: a flattened bvh whose nodes hold their bounds at both ends of the
+// shutter, interpolated to the time of each ray
+#ifndef MOTION_BVH_H
+#define MOTION_BVH_H
+
+#include "hitable.h"
+#include "bvh.h"
+#include "linear_bvh.h"
+#include <stdint.h>
+
+// the box at the shutter start and how far its planes move until the end.
+// bounds of primitives are assumed to move linearly in between, which holds
+// for moving_sphere; everything else reports the same box at both ends, and
+// the parent of linearly moving boxes is bounded by the lerp of their unions.
+struct motion_bvh_node
+{
+    float bmin[3], bmax[3];
+    float dmin[3], dmax[3];
+    int32_t offset;  // leaf : first primitive, interior : second child
+    uint16_t count;  // leaf : number of primitives, interior : 0
+    uint8_t axis;    // interior : split axis, picks the near child
+    uint8_t dynamic; // something below is animated, refit() visits it
+
+    // the box at shutter fraction s
+    void at(float s, float* lo, float* hi) const
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            lo[i] = bmin[i] + s * dmin[i];
+            hi[i] = bmax[i] + s * dmax[i];
+        }
+    }
+    // slab_hit() against the box at shutter fraction s
+    bool hit(float s, const vec3& o, const vec3& inv_d, float t_min, float t_max) const
+    {
+        for(int i = 0; i < 3; ++i)
+        {
+            float t0 = (bmin[i] + s * dmin[i] - o[i]) * inv_d[i];
+            float t1 = (bmax[i] + s * dmax[i] - o[i]) * inv_d[i];
+            t_min = std::max(t_min, std::min(t0, t1));
+            t_max = std::min(t_max, std::max(t0, t1));
+        }
+        return t_min <= t_max;
+    }
+};
+static_assert(sizeof(motion_bvh_node) == 56, "motion_bvh_node should hold two boxes and the links");
+
+class motion_bvh : public hitable
+{
+public:
+    motion_bvh(hitable** l, int n, float time0, float time1);
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const;
+    virtual bool bounding_box(float t0, float t1, aabb& box) const;
+    virtual bool animated() const { return !nodes.empty() && nodes[0].dynamic; }
+    virtual void refit(float t0, float t1);
+    void stats(bvh_stats& s) const;
+
+    std::vector<motion_bvh_node> nodes; // empty when built over no primitives
+    std::vector<hitable*> prims;        // in leaf order
+    float time0, inv_duration;          // the shutter the bounds are for
+    float built_cost = 0;               // sah cost when built, the refit baseline
+private:
+    int flatten(const bvh_builder& b, const bvh_build_node& node);
+    void fit(float t0, float t1, bool all);
+    float fraction(float time) const
+    {
+        return std::min(1.0f, std::max(0.0f, (time - time0) * inv_duration));
+    }
+};
+
+template<>
+struct arena_category_of<motion_bvh>
+{
+    static const arena_category value = ARENA_ACCEL;
+};
+
+// the tree is built over the boxes at the middle of the shutter, which is
+// where a moving primitive spends its time on average, instead of over the
+// union of its path. an empty list leaves nodes empty, as in linear_bvh
+inline motion_bvh::motion_bvh(hitable** l, int n, float t0, float t1)
+{
+    if(n == 0)
+    {
+        fit(t0, t1, true); // only records the shutter
+        return;
+    }
+    float tm = 0.5f * (t0 + t1);
+    bvh_builder b(l, n, tm, tm);
+    nodes.reserve(b.nodes.size());
+    prims.resize(n);
+    for(int i = 0; i < n; ++i)
+        prims[i] = b.prims[i].ptr;
+    flatten(b, b.root());
+    fit(t0, t1, true);
+    if(bvh_report || animated())
+    {
+        bvh_stats s;
+        stats(s);
+        built_cost = s.sah_cost;
+        if(bvh_report) print_bvh_report(std::cerr, s);
+    }
+}
+
+// depth first like linear_bvh, the bounds are filled in by fit(). bvh_builder
+// keeps the tree within bvh_max_depth, the size of the traversal stacks
+inline int motion_bvh::flatten(const bvh_builder& b, const bvh_build_node& node)
+{
+    int index = int(nodes.size());
+    nodes.emplace_back();
+    if(node.leaf())
+    {
+        nodes[index].offset = node.begin;
+        nodes[index].count = uint16_t(node.n);
+        nodes[index].dynamic = 0;
+        for(int i = 0; i < node.n; ++i)
+            nodes[index].dynamic |= prims[node.begin + i]->animated();
+        return index;
+    }
+    flatten(b, b.nodes[node.child[0]]);
+    int second = flatten(b, b.nodes[node.child[1]]);
+    nodes[index].offset = second;
+    nodes[index].count = 0;
+    nodes[index].axis = uint8_t(node.axis);
+    nodes[index].dynamic = nodes[index + 1].dynamic | nodes[second].dynamic;
+    return index;
+}
+
+// bottom up in one backwards pass: leaves take the boxes of their primitives
+// at t0 and t1, interior nodes the union of their children's at each end
+inline void motion_bvh::fit(float t0, float t1, bool all)
+{
+    time0 = t0;
+    inv_duration = t1 > t0 ? 1 / (t1 - t0) : 0;
+    for(int i = int(nodes.size()) - 1; i >= 0; --i)
+    {
+        motion_bvh_node& node = nodes[i];
+        if(!all && !node.dynamic) continue;
+        aabb box0 = empty_box(), box1 = empty_box();
+        if(node.count > 0)
+            for(int k = 0; k < node.count; ++k)
+            {
+                hitable* h = prims[node.offset + k];
+                aabb b0, b1;
+                if(!all && h->animated()) h->refit(t0, t1);
+                h->bounding_box(t0, t0, b0);
+                h->bounding_box(t1, t1, b1);
+                box0 = surrounding_box(box0, b0);
+                box1 = surrounding_box(box1, b1);
+            }
+        else {
+            for(const motion_bvh_node* c : {&nodes[i + 1], &nodes[node.offset]})
+            {
+                float lo[3], hi[3];
+                c->at(0, lo, hi);
+                box0 = surrounding_box(box0, aabb(vec3(lo[0], lo[1], lo[2]), vec3(hi[0], hi[1], hi[2])));
+                c->at(1, lo, hi);
+                box1 = surrounding_box(box1, aabb(vec3(lo[0], lo[1], lo[2]), vec3(hi[0], hi[1], hi[2])));
+            }
+        }
+        for(int a = 0; a < 3; ++a)
+        {
+            node.bmin[a] = box0.min()[a];
+            node.bmax[a] = box0.max()[a];
+            node.dmin[a] = box1.min()[a] - box0.min()[a];
+            node.dmax[a] = box1.max()[a] - box0.max()[a];
+        }
+    }
+}
+
+inline void motion_bvh::refit(float t0, float t1)
+{
+    if(!animated()) return;
+    fit(t0, t1, false);
+    bvh_stats s;
+    stats(s);
+    if(s.sah_cost <= built_cost * bvh_refit_threshold) return;
+    std::vector<hitable*> l = prims;
+    ++bvh_rebuilds;
+    *this = motion_bvh(l.data(), int(l.size()), t0, t1);
+}
+
+inline bool motion_bvh::bounding_box(float t0, float t1, aabb& b) const
+{
+    if(nodes.empty())
+    {
+        b = empty_box();
+        return true;
+    }
+    float lo0[3], hi0[3], lo1[3], hi1[3];
+    nodes[0].at(fraction(t0), lo0, hi0);
+    nodes[0].at(fraction(t1), lo1, hi1);
+    b = surrounding_box(aabb(vec3(lo0[0], lo0[1], lo0[2]), vec3(hi0[0], hi0[1], hi0[2])),
+                        aabb(vec3(lo1[0], lo1[1], lo1[2]), vec3(hi1[0], hi1[1], hi1[2])));
+    return true;
+}
+
+// linear_bvh::hit() with every node box moved to the ray's time first
+inline bool motion_bvh::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+    if(nodes.empty()) return false;
+    vec3 o = r.origin();
+    vec3 inv_d(1.0f / r.direction().x(), 1.0f / r.direction().y(), 1.0f / r.direction().z());
+    int dir_neg[3] = {inv_d.x() < 0, inv_d.y() < 0, inv_d.z() < 0};
+    float s = fraction(r.time());
+    int stack[bvh_max_depth];
+    int sp = 0;
+    int index = 0;
+    bool hit_anything = false;
+    int visited = 0;
+    for(;;)
+    {
+        const motion_bvh_node& node = nodes[index];
+        ++visited;
+        if(node.hit(s, o, inv_d, t_min, t_max))
+        {
+            if(node.count > 0)
+            {
+                for(int i = 0; i < node.count; ++i)
+                    if(prims[node.offset + i]->hit(r, t_min, t_max, rec))
+                    {
+                        hit_anything = true;
+                        t_max = rec.t;
+                    }
+                if(sp == 0) break;
+                index = stack[--sp];
+            }
+            else if(dir_neg[node.axis]) {
+                stack[sp++] = index + 1;
+                index = node.offset;
+            }
+            else {
+                stack[sp++] = node.offset;
+                index = index + 1;
+            }
+        }
+        else {
+            if(sp == 0) break;
+            index = stack[--sp];
+        }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return hit_anything;
+}
+
+inline bool motion_bvh::occluded(const ray& r, float t_min, float t_max) const
+{
+    if(nodes.empty()) return false;
+    vec3 o = r.origin();
+    vec3 inv_d(1.0f / r.direction().x(), 1.0f / r.direction().y(), 1.0f / r.direction().z());
+    int dir_neg[3] = {inv_d.x() < 0, inv_d.y() < 0, inv_d.z() < 0};
+    float s = fraction(r.time());
+    int stack[bvh_max_depth];
+    int sp = 0;
+    int index = 0;
+    bool blocked = false;
+    int visited = 0;
+    for(;;)
+    {
+        const motion_bvh_node& node = nodes[index];
+        ++visited;
+        if(node.hit(s, o, inv_d, t_min, t_max))
+        {
+            if(node.count > 0)
+            {
+                for(int i = 0; i < node.count && !blocked; ++i)
+                    blocked = prims[node.offset + i]->occluded(r, t_min, t_max);
+                if(blocked || sp == 0) break;
+                index = stack[--sp];
+            }
+            else if(dir_neg[node.axis]) {
+                stack[sp++] = index + 1;
+                index = node.offset;
+            }
+            else {
+                stack[sp++] = node.offset;
+                index = index + 1;
+            }
+        }
+        else {
+            if(sp == 0) break;
+            index = stack[--sp];
+        }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return blocked;
+}
+
+// areas are averaged over the shutter, from the boxes at both ends
+inline void motion_bvh::stats(bvh_stats& s) const
+{
+    s = bvh_stats();
+    if(nodes.empty()) return;
+    auto area = [this](int i) {
+        float a = 0;
+        for(float t : {0.0f, 1.0f})
+        {
+            float lo[3], hi[3];
+            nodes[i].at(t, lo, hi);
+            float dx = hi[0] - lo[0], dy = hi[1] - lo[1], dz = hi[2] - lo[2];
+            a += dx * dy + dy * dz + dz * dx;
+        }
+        return a;
+    };
+    float root_area = area(0);
+    // (node, depth) pairs
+    std::vector<std::pair<int, int>> todo(1, std::make_pair(0, 1));
+    while(!todo.empty())
+    {
+        int i = todo.back().first, depth = todo.back().second;
+        todo.pop_back();
+        float p = root_area > 0 ? area(i) / root_area : 1;
+        if(nodes[i].count > 0)
+        {
+            s.add_leaf(p, depth, nodes[i].count);
+            continue;
+        }
+        s.add_interior(p, depth);
+        todo.push_back(std::make_pair(i + 1, depth + 1));
+        todo.push_back(std::make_pair(nodes[i].offset, depth + 1));
+    }
+}
+
+#endif
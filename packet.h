@@ -0,0 +1,108 @@
+// ray packets: simd_width coherent rays in SoA layout
+#ifndef PACKET_H
+#define PACKET_H
+
+#include "ray.h"
+#include "simd.h"
+#include <float.h>
+#include <algorithm>
+
+class sampler;
+
+struct alignas(32) ray_packet
+{
+    float ox[simd_width], oy[simd_width], oz[simd_width];
+    float dx[simd_width], dy[simd_width], dz[simd_width];
+    float inv_dx[simd_width], inv_dy[simd_width], inv_dz[simd_width];
+    float time[simd_width];
+    float t_max[simd_width]; // closest hit so far per lane
+    sampler* smp[simd_width]; // each lane's path sampler, for media reached through hit()
+    int active;              // lanes holding a ray
+
+    // interval bounds over the active lanes, valid when coherent
+    bool coherent; // every active lane has the same direction signs
+    int neg[3];
+    float omin[3], omax[3], inv_min[3], inv_max[3];
+
+    void set(int k, const ray& r, float tmax = FLT_MAX)
+    {
+        ox[k] = r.A.x(); oy[k] = r.A.y(); oz[k] = r.A.z();
+        dx[k] = r.B.x(); dy[k] = r.B.y(); dz[k] = r.B.z();
+        inv_dx[k] = 1.0f / dx[k]; inv_dy[k] = 1.0f / dy[k]; inv_dz[k] = 1.0f / dz[k];
+        time[k] = r._time;
+        t_max[k] = tmax;
+    }
+    ray get(int k) const
+    {
+        return ray(vec3(ox[k], oy[k], oz[k]), vec3(dx[k], dy[k], dz[k]), time[k]);
+    }
+    // call once every active lane is set
+    void prepare(int mask)
+    {
+        active = mask;
+        const float* o[3] = {ox, oy, oz};
+        const float* inv[3] = {inv_dx, inv_dy, inv_dz};
+        int first = 0;
+        while(!(mask >> first & 1)) ++first;
+        coherent = true;
+        for(int a = 0; a < 3; ++a)
+        {
+            neg[a] = inv[a][first] < 0;
+            omin[a] = inv_min[a] = FLT_MAX;
+            omax[a] = inv_max[a] = -FLT_MAX;
+            for(int k = 0; k < simd_width; ++k)
+            {
+                if(!(mask >> k & 1)) continue;
+                if((inv[a][k] < 0) != bool(neg[a])) coherent = false;
+                omin[a] = fminf(omin[a], o[a][k]);
+                omax[a] = fmaxf(omax[a], o[a][k]);
+                inv_min[a] = fminf(inv_min[a], inv[a][k]);
+                inv_max[a] = fmaxf(inv_max[a], inv[a][k]);
+            }
+        }
+    }
+};
+
+// interval arithmetic culling (Boulos et al. 2006): bounds every lane's slab
+// distances at once. false means no active lane can hit the box.
+inline bool packet_may_hit(const ray_packet& p, const float* bmin, const float* bmax, float t_min)
+{
+    float t_near = t_min, t_far = FLT_MAX;
+    for(int a = 0; a < 3; ++a)
+    {
+        float near_plane = p.neg[a] ? bmax[a] : bmin[a];
+        float far_plane = p.neg[a] ? bmin[a] : bmax[a];
+        // [plane - omax, plane - omin] * [inv_min, inv_max]
+        float n0 = (near_plane - p.omax[a]) * p.inv_min[a], n1 = (near_plane - p.omax[a]) * p.inv_max[a];
+        float n2 = (near_plane - p.omin[a]) * p.inv_min[a], n3 = (near_plane - p.omin[a]) * p.inv_max[a];
+        float f0 = (far_plane - p.omax[a]) * p.inv_min[a], f1 = (far_plane - p.omax[a]) * p.inv_max[a];
+        float f2 = (far_plane - p.omin[a]) * p.inv_min[a], f3 = (far_plane - p.omin[a]) * p.inv_max[a];
+        float lo = std::min(std::min(n0, n1), std::min(n2, n3));
+        float hi = std::max(std::max(f0, f1), std::max(f2, f3));
+        // comparisons with NaN (0 * inf) are false and keep the bound
+        if(lo > t_near) t_near = lo;
+        if(hi < t_far) t_far = hi;
+    }
+    return t_near <= t_far;
+}
+
+// exact per lane slab test, returns the lanes of mask that hit the box
+inline int packet_box_hit(const ray_packet& p, int mask, const float* bmin, const float* bmax, float t_min)
+{
+    vfloat t0(t_min);
+    vfloat t1 = vfloat::load(p.t_max);
+    const float* o[3] = {p.ox, p.oy, p.oz};
+    const float* inv[3] = {p.inv_dx, p.inv_dy, p.inv_dz};
+    for(int a = 0; a < 3; ++a)
+    {
+        vfloat oa = vfloat::load(o[a]);
+        vfloat ia = vfloat::load(inv[a]);
+        vfloat ta = (vfloat(bmin[a]) - oa) * ia;
+        vfloat tb = (vfloat(bmax[a]) - oa) * ia;
+        t0 = vmax(vmin(ta, tb), t0);
+        t1 = vmin(vmax(ta, tb), t1);
+    }
+    return movemask(t0 <= t1) & mask;
+}
+
+#endif
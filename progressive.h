@@ -0,0 +1,262 @@
+// progressive rendering: passes of samples summed into a float buffer that can
+// be checkpointed, resumed and merged
+#ifndef PROGRESSIVE_H
+#define PROGRESSIVE_H
+
+#include "render.h"
+#include "image_io.h"
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+#include <math.h>
+#include <float.h>
+#include <chrono>
+#include <fstream>
+#include <iostream>
+#include <string>
+#include <vector>
+
+inline float luminance(const vec3& c)
+{
+    return 0.2126f * c[0] + 0.7152f * c[1] + 0.0722f * c[2];
+}
+
+//accumulation buffer--------------------------------------------------------------------------
+// radiance sums and sample counts per pixel, row 0 at the bottom like framebuffer.
+// every pass is a batch: the spread of the batch means estimates the variance
+// of a pixel without keeping per sample values.
+class accum_buffer
+{
+public:
+    accum_buffer(int w = 0, int h = 0)
+        : nx(w), ny(h), sum(size_t(w) * h, vec3(0)), count(size_t(w) * h, 0),
+          lum_sq(size_t(w) * h, 0), batches(size_t(w) * h, 0) {}
+
+    // pass holds the mean of spp new samples for the pixels of active, every pixel when null
+    void add(const framebuffer& pass, int spp, const uint8_t* active = nullptr)
+    {
+        for(size_t k = 0; k < sum.size(); ++k)
+        {
+            if(active && !active[k]) continue;
+            float l = luminance(pass.pixels[k]);
+            sum[k] += pass.pixels[k] * float(spp);
+            count[k] += spp;
+            lum_sq[k] += float(spp) * l * l;
+            ++batches[k];
+        }
+    }
+    // runs with different seeds are independent estimates, their sums simply add
+    bool merge(const accum_buffer& other)
+    {
+        if(other.nx != nx || other.ny != ny || other.scene != scene || other.scene_seed != scene_seed)
+            return false;
+        for(size_t k = 0; k < sum.size(); ++k)
+        {
+            sum[k] += other.sum[k];
+            count[k] += other.count[k];
+            lum_sq[k] += other.lum_sq[k];
+            batches[k] += other.batches[k];
+        }
+        return true;
+    }
+    void resolve(framebuffer& fb) const
+    {
+        for(size_t k = 0; k < sum.size(); ++k)
+            fb.pixels[k] = count[k] ? sum[k] / float(count[k]) : vec3(0);
+    }
+    // standard error of the pixel mean in display units, where the gamma 2
+    // output brightens dark pixels: d sqrt(L) = dL / (2 sqrt(L))
+    float display_error(size_t k) const
+    {
+        if(batches[k] < 2) return FLT_MAX;
+        float n = float(count[k]);
+        float mean = luminance(sum[k]) / n;
+        // sum over batches of n_b (m_b - mean)^2, divided by (batches - 1)
+        float var = std::max(0.0f, (lum_sq[k] - n * mean * mean) / float(batches[k] - 1));
+        return sqrtf(var / n) / (2 * sqrtf(std::max(mean, 1e-4f)));
+    }
+    uint32_t min_count() const
+    {
+        uint32_t m = UINT32_MAX;
+        for(uint32_t c : count) m = std::min(m, c);
+        return count.empty() ? 0 : m;
+    }
+
+    int nx, ny;
+    std::vector<vec3> sum;
+    std::vector<uint32_t> count;
+    std::vector<float> lum_sq;      // sum over batches of spp * mean luminance^2
+    std::vector<uint32_t> batches;
+    uint64_t seed = 0;       // of the run whose sample sequence a resume continues
+    uint64_t scene_seed = 0; // the scene layout, must match to merge
+    std::string scene;       // preset name, must match to merge
+};
+
+//checkpoints----------------------------------------------------------------------------------
+// "RTCK", version, nx, ny, seed, scene seed, scene name (32 bytes), then the sums,
+// counts, luminance squares and batch counts of every pixel, all little endian
+// as written by x86
+const uint32_t checkpoint_version = 2;
+
+inline bool save_checkpoint(const std::string& path, const accum_buffer& acc)
+{
+    // written aside and renamed, so a crash mid write keeps the last checkpoint
+    std::string tmp = path + ".tmp";
+    {
+        std::ofstream f(tmp, std::ios::binary);
+        char name[32] = {0};
+        strncpy(name, acc.scene.c_str(), sizeof(name) - 1);
+        int32_t dims[2] = {acc.nx, acc.ny};
+        f.write("RTCK", 4);
+        f.write((const char*)&checkpoint_version, 4);
+        f.write((const char*)dims, 8);
+        f.write((const char*)&acc.seed, 8);
+        f.write((const char*)&acc.scene_seed, 8);
+        f.write(name, 32);
+        f.write((const char*)acc.sum.data(), acc.sum.size() * sizeof(vec3));
+        f.write((const char*)acc.count.data(), acc.count.size() * sizeof(uint32_t));
+        f.write((const char*)acc.lum_sq.data(), acc.lum_sq.size() * sizeof(float));
+        f.write((const char*)acc.batches.data(), acc.batches.size() * sizeof(uint32_t));
+        if(!f) return false;
+    }
+    return rename(tmp.c_str(), path.c_str()) == 0;
+}
+
+inline bool load_checkpoint(const std::string& path, accum_buffer& acc)
+{
+    std::ifstream f(path, std::ios::binary);
+    char magic[4], name[32];
+    uint32_t version = 0;
+    int32_t dims[2];
+    uint64_t seed, scene_seed;
+    f.read(magic, 4);
+    f.read((char*)&version, 4);
+    f.read((char*)dims, 8);
+    f.read((char*)&seed, 8);
+    f.read((char*)&scene_seed, 8);
+    f.read(name, 32);
+    if(!f || memcmp(magic, "RTCK", 4) != 0 || version != checkpoint_version || dims[0] <= 0 || dims[1] <= 0)
+        return false;
+    accum_buffer a(dims[0], dims[1]);
+    a.seed = seed;
+    a.scene_seed = scene_seed;
+    a.scene = std::string(name, strnlen(name, sizeof(name)));
+    f.read((char*)a.sum.data(), a.sum.size() * sizeof(vec3));
+    f.read((char*)a.count.data(), a.count.size() * sizeof(uint32_t));
+    f.read((char*)a.lum_sq.data(), a.lum_sq.size() * sizeof(float));
+    f.read((char*)a.batches.data(), a.batches.size() * sizeof(uint32_t));
+    if(!f) return false;
+    acc = std::move(a);
+    return true;
+}
+
+//heatmap-------------------------------------------------------------------------------------
+// samples per pixel from lo (blue) over green to hi (red)
+inline void sample_heatmap(const accum_buffer& acc, int lo, int hi, framebuffer& fb)
+{
+    for(size_t k = 0; k < acc.count.size(); ++k)
+    {
+        float t = hi > lo ? float(int(acc.count[k]) - lo) / float(hi - lo) : 1;
+        t = std::min(1.0f, std::max(0.0f, t));
+        vec3 c(std::max(0.0f, 2 * t - 1), 1 - fabsf(2 * t - 1), std::max(0.0f, 1 - 2 * t));
+        fb.pixels[k] = c * c; // undo the gamma of the writers
+    }
+}
+
+//progressive loop-----------------------------------------------------------------------------
+struct progressive_settings
+{
+    int target_spp = 30;            // per pixel, samples already in the buffer count
+    int pass_spp = 0;               // samples per pass, 0 : all in one pass (4 when adaptive or checkpointing)
+    double checkpoint_seconds = 60; // between checkpoints, 0 : after every pass
+    std::string checkpoint;         // empty : no checkpoints
+    std::string preview;            // image rewritten after every pass, empty : none
+
+    // adaptive sampling: after min_spp, pixels get more passes until their
+    // display_error (including their neighbours') is below threshold or they
+    // reach target_spp
+    bool adaptive = false;
+    int min_spp = 16;
+    float threshold = 0.01f; // about 2.5 levels of an 8 bit image
+};
+
+// the largest error of the 3x3 neighbourhood, so a pixel whose few batches
+// happen to agree does not stop next to noisy ones
+inline void converged_pixels(const accum_buffer& acc, float threshold, std::vector<uint8_t>& done)
+{
+    std::vector<float> err(acc.count.size());
+    for(size_t k = 0; k < err.size(); ++k)
+        err[k] = acc.display_error(k);
+    done.assign(err.size(), 0);
+    for(int j = 0; j < acc.ny; ++j)
+        for(int i = 0; i < acc.nx; ++i)
+        {
+            float e = 0;
+            for(int y = std::max(0, j - 1); y <= std::min(acc.ny - 1, j + 1); ++y)
+                for(int x = std::max(0, i - 1); x <= std::min(acc.nx - 1, i + 1); ++x)
+                    e = std::max(e, err[size_t(y) * acc.nx + x]);
+            done[size_t(j) * acc.nx + i] = e < threshold;
+        }
+}
+
+// adds passes until every pixel of acc has target_spp samples, or has converged
+// when adaptive. each pixel continues its own sample sequence after the
+// samples already in acc, so an interrupted run resumed from its checkpoint
+// renders the same image as an uninterrupted one (up to float rounding).
+inline void render_progressive(const camera& cam, hitable* world, render_settings settings,
+                               const progressive_settings& ps, accum_buffer& acc,
+                               image_writer* writer = nullptr, render_stats* stats = nullptr)
+{
+    settings.seed = acc.seed;
+    // checkpoints are only written between passes
+    int pass_spp = ps.pass_spp > 0 ? ps.pass_spp : ps.adaptive || !ps.checkpoint.empty() ? 4 : ps.target_spp;
+    framebuffer pass(acc.nx, acc.ny);
+    std::vector<uint8_t> active(acc.count.size()), done;
+    render_stats total;
+    auto last_checkpoint = std::chrono::steady_clock::now();
+    for(;;)
+    {
+        if(ps.adaptive) converged_pixels(acc, ps.threshold, done);
+        size_t n_active = 0;
+        int least = ps.target_spp;
+        for(size_t k = 0; k < active.size(); ++k)
+        {
+            int c = int(acc.count[k]);
+            active[k] = c < ps.target_spp && (!ps.adaptive || c < ps.min_spp || !done[k]);
+            n_active += active[k];
+            if(active[k]) least = std::min(least, c);
+        }
+        if(n_active == 0) break;
+        // every active pixel gets the same samples, pixels that started ahead
+        // (merged runs) may end up to one pass above target_spp
+        settings.ns = std::min(pass_spp, ps.target_spp - least);
+        settings.pixel_first = acc.count.data();
+        settings.active = active.data();
+
+        render_stats s;
+        render(cam, world, settings, pass, &s);
+        acc.add(pass, settings.ns, active.data());
+        total.paths += s.paths;
+        total.segments += s.segments;
+        total.seconds += s.seconds;
+        std::cerr << "pass: " << n_active << " pixels, " << acc.min_count() << " spp min, " << s.seconds << "s\n";
+
+        if(writer && !ps.preview.empty())
+        {
+            acc.resolve(pass);
+            writer->submit(pass, ps.preview);
+        }
+        auto now = std::chrono::steady_clock::now();
+        if(!ps.checkpoint.empty() && std::chrono::duration<double>(now - last_checkpoint).count() >= ps.checkpoint_seconds)
+        {
+            if(!save_checkpoint(ps.checkpoint, acc))
+                std::cerr << "could not write checkpoint " << ps.checkpoint << "\n";
+            last_checkpoint = now;
+        }
+    }
+    if(!ps.checkpoint.empty() && !save_checkpoint(ps.checkpoint, acc))
+        std::cerr << "could not write checkpoint " << ps.checkpoint << "\n";
+    if(stats) *stats = total;
+}
+
+#endif
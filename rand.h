@@ -1,27 +1,101 @@
 // generate random number
-#ifndef RAND_H 
+#ifndef RAND_H
 #define RAND_H
 
+#include "vec3.h"
+#include <stdint.h>
+
+// 64 bit mixing function (splitmix64 finalizer), turns counters into seeds
+inline uint64_t hash64(uint64_t x)
+{
+    x += 0x9e3779b97f4a7c15ULL;
+    x = (x ^ (x >> 30)) * 0xbf58476d1ce4e5b9ULL;
+    x = (x ^ (x >> 27)) * 0x94d049bb133111ebULL;
+    return x ^ (x >> 31);
+}
+
+// pcg32 (O'Neill 2014): 64 bit LCG state with a permuted 32 bit output.
+// cheap to seed, so the renderer reseeds it for every pixel sample and the
+// image no longer depends on which thread rendered which tile.
+class pcg32
+{
+public:
+    pcg32() { seed(0x853c49e6748fea9bULL, 0xda3e39cb94b95bdbULL); }
+    pcg32(uint64_t s, uint64_t stream) { seed(s, stream); }
+
+    void seed(uint64_t s, uint64_t stream)
+    {
+        state = 0;
+        inc = (stream << 1) | 1;
+        next_uint();
+        state += s;
+        next_uint();
+    }
+    // independent sequence for sample `sample` of pixel `pixel`
+    void seed_sample(uint64_t pixel, uint64_t sample, uint64_t base = 0)
+    {
+        seed(hash64(hash64(hash64(base) + sample) ^ pixel), pixel);
+    }
+    uint32_t next_uint()
+    {
+        uint64_t old = state;
+        state = old * 6364136223846793005ULL + inc;
+        uint32_t xorshifted = uint32_t(((old >> 18) ^ old) >> 27);
+        uint32_t rot = uint32_t(old >> 59);
+        return (xorshifted >> rot) | (xorshifted << ((-rot) & 31));
+    }
+    // [0, 1)
+    float next_float()
+    {
+        return float(next_uint() >> 8) * (1.0f / 16777216.0f);
+    }
+
+    uint64_t state, inc;
+};
+
+// generator of the calling thread. the renderer seeds it per pixel sample;
+// code without a generator at hand (scene setup, volumes) draws from it.
+inline pcg32& thread_rng()
+{
+    static thread_local pcg32 rng;
+    return rng;
+}
+
+inline float random(pcg32& rng)
+{
+    return rng.next_float();
+}
+
 inline float random() {
-    return (float)(rand() / float(RAND_MAX));
+    return random(thread_rng());
 }
 
-inline vec3 random_in_unit_sphere()
+inline vec3 random_in_unit_sphere(pcg32& rng)
 {
     vec3 p;
     do {
-        p = 2.0 * vec3(random(), random(), random()) - vec3(1.0);
+        p = 2.0 * vec3(random(rng), random(rng), random(rng)) - vec3(1.0);
     } while (p.squared_length() >= 1.0);
     return p;
 }
 
-inline vec3 random_in_unit_disk()
+inline vec3 random_in_unit_sphere()
+{
+    return random_in_unit_sphere(thread_rng());
+}
+
+inline vec3 random_in_unit_disk(pcg32& rng)
 {
     vec3 p;
     do {
-        p = 2.0 * vec3(random(), random(), 0) - vec3(1, 1, 0);
+        p = 2.0 * vec3(random(rng), random(rng), 0) - vec3(1, 1, 0);
     } while (dot(p, p) >= 1.0);
     return p;
 }
 
-#endif
\ No newline at end of file
+inline vec3 random_in_unit_disk()
+{
+    return random_in_unit_disk(thread_rng());
+}
+
+#endif
@@ -2,8 +2,90 @@
 #define RECTANGLE_H
 
 #include "hitable.h"
+#include "material.h"
 #include "aabb.h"
 
+// packet version of the rect tests below: lanes of mask whose ray crosses the
+// plane coordinate[axis] == k inside [a0, a1] x [b0, b1] of the two other axes
+// (in x, y, z order). distances are written to t.
+inline int rect_packet_hit(const ray_packet& p, int mask, float t_min, int axis, float k,
+                           float a0, float a1, float b0, float b1, float* t)
+{
+    const float* o[3] = {p.ox, p.oy, p.oz};
+    const float* d[3] = {p.dx, p.dy, p.dz};
+    int ax = axis == 0 ? 1 : 0;
+    int bx = axis == 2 ? 1 : 2;
+    vfloat tt = (vfloat(k) - vfloat::load(o[axis])) / vfloat::load(d[axis]);
+    vfloat a = vfloat::load(o[ax]) + tt * vfloat::load(d[ax]);
+    vfloat b = vfloat::load(o[bx]) + tt * vfloat::load(d[bx]);
+    vfloat inside = (tt >= vfloat(t_min)) & (tt <= vfloat::load(p.t_max)) &
+                    (a >= vfloat(a0)) & (a <= vfloat(a1)) & (b >= vfloat(b0)) & (b <= vfloat(b1));
+    tt.store(t);
+    return movemask(inside) & mask;
+}
+
+// fills recs for the lanes returned by rect_packet_hit
+template <class R>
+inline int rect_packet_records(const R& rect, ray_packet& p, int hits, const float* t, hit_record* recs)
+{
+    for(int k = 0; k < simd_width; ++k)
+        if(hits >> k & 1)
+        {
+            p.t_max[k] = t[k];
+            record_hit(recs[k], t[k], &rect);
+        }
+    return hits;
+}
+
+// light sampling of the rect coordinate[axis] == k, [a0, a1] x [b0, b1]:
+// uniform in area, converted to solid angle. diffuse_light emits on both sides.
+inline bool rect_sample_light(int axis, float k, float a0, float a1, float b0, float b1, const material* mp,
+                              const vec3& o, sampler& smp, light_sample& ls)
+{
+    int ax = axis == 0 ? 1 : 0;
+    int bx = axis == 2 ? 1 : 2;
+    float u, v;
+    smp.get_2d(u, v);
+    vec3 p;
+    p[axis] = k;
+    p[ax] = a0 + u * (a1 - a0);
+    p[bx] = b0 + v * (b1 - b0);
+    vec3 d = p - o;
+    float dist2 = d.squared_length();
+    ls.dist = sqrtf(dist2);
+    ls.wi = d / ls.dist;
+    float cosine = fabsf(ls.wi[axis]);
+    if(cosine < 1e-6f) return false;
+    ls.pdf = dist2 / (cosine * (a1 - a0) * (b1 - b0));
+    ls.emitted = emission(mp->record(), u, v, p);
+    return true;
+}
+
+inline float rect_light_pdf(int axis, float k, float a0, float a1, float b0, float b1,
+                            const vec3& o, const vec3& d, float& t)
+{
+    int ax = axis == 0 ? 1 : 0;
+    int bx = axis == 2 ? 1 : 2;
+    t = (k - o[axis]) / d[axis];
+    if(!(t > 0)) return 0;
+    float a = o[ax] + t * d[ax], b = o[bx] + t * d[bx];
+    if(a < a0 || a > a1 || b < b0 || b > b1) return 0;
+    return t * t / (fabsf(d[axis]) * (a1 - a0) * (b1 - b0));
+}
+
+// any crossing of the rect coordinate[axis] == k, [a0, a1] x [b0, b1] in (t_min, t_max)
+inline bool rect_occluded(int axis, float k, float a0, float a1, float b0, float b1,
+                          const ray& r, float t_min, float t_max)
+{
+    int ax = axis == 0 ? 1 : 0;
+    int bx = axis == 2 ? 1 : 2;
+    float t = (k - r.origin()[axis]) / r.direction()[axis];
+    if(!(t > t_min && t < t_max)) return false;
+    float a = r.origin()[ax] + t * r.direction()[ax];
+    float b = r.origin()[bx] + t * r.direction()[bx];
+    return a >= a0 && a <= a1 && b >= b0 && b <= b1;
+}
+
 class xy_rect : public hitable
 {
 public:
@@ -19,13 +101,41 @@ x0(_x0), x1(_x1), y0(_y0), y1(_y1), k(_k), mp(mat) {};
         float y = r.origin().y() + t * r.direction().y();
         if(x < x0 || x > x1 || y < y0 || y > y1) 
             return false;
+        record_hit(rec, t, this);
+        return true;
+    }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        alignas(32) float t[simd_width];
+        int hits = rect_packet_hit(p, mask, t_min, 2, k, x0, x1, y0, y1, t);
+        return hits ? rect_packet_records(*this, p, hits, t, recs) : 0;
+    }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        set_record(r, rec.t, rec);
+    }
+    void set_record(const ray& r, float t, hit_record& rec) const
+    {
+        float x = r.origin().x() + t * r.direction().x();
+        float y = r.origin().y() + t * r.direction().y();
         rec.u = (x - x0) / (x1 - x0);
         rec.v = (y - y0) / (y1 - y0);
         rec.t = t;
         rec.mat_ptr = mp;
         rec.p = r.point_at_parameter(t);
         rec.normal = vec3(0, 0, 1);
-        return true;
+    }
+    virtual bool occluded(const ray& r, float t0, float t1) const
+    {
+        return rect_occluded(2, k, x0, x1, y0, y1, r, t0, t1);
+    }
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const
+    {
+        return rect_sample_light(2, k, x0, x1, y0, y1, mp, o, smp, ls);
+    }
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const
+    {
+        return rect_light_pdf(2, k, x0, x1, y0, y1, o, d, t);
     }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
@@ -51,13 +161,41 @@ x0(_x0), x1(_x1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
         float z = r.origin().z() + t * r.direction().z();
         if(x < x0 || x > x1 || z < z0 || z > z1) 
             return false;
+        record_hit(rec, t, this);
+        return true;
+    }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        alignas(32) float t[simd_width];
+        int hits = rect_packet_hit(p, mask, t_min, 1, k, x0, x1, z0, z1, t);
+        return hits ? rect_packet_records(*this, p, hits, t, recs) : 0;
+    }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        set_record(r, rec.t, rec);
+    }
+    void set_record(const ray& r, float t, hit_record& rec) const
+    {
+        float x = r.origin().x() + t * r.direction().x();
+        float z = r.origin().z() + t * r.direction().z();
         rec.u = (x - x0) / (x1 - x0);
         rec.v = (z - z0) / (z1 - z0);
         rec.t = t;
         rec.mat_ptr = mp;
         rec.p = r.point_at_parameter(t);
         rec.normal = vec3(0, 1, 0);
-        return true;
+    }
+    virtual bool occluded(const ray& r, float t0, float t1) const
+    {
+        return rect_occluded(1, k, x0, x1, z0, z1, r, t0, t1);
+    }
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const
+    {
+        return rect_sample_light(1, k, x0, x1, z0, z1, mp, o, smp, ls);
+    }
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const
+    {
+        return rect_light_pdf(1, k, x0, x1, z0, z1, o, d, t);
     }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
@@ -83,13 +221,41 @@ y0(_y0), y1(_y1), z0(_z0), z1(_z1), k(_k), mp(mat) {};
         float z = r.origin().z() + t * r.direction().z();
         if(z < z0 || z > z1 || y < y0 || y > y1) 
             return false;
+        record_hit(rec, t, this);
+        return true;
+    }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        alignas(32) float t[simd_width];
+        int hits = rect_packet_hit(p, mask, t_min, 0, k, y0, y1, z0, z1, t);
+        return hits ? rect_packet_records(*this, p, hits, t, recs) : 0;
+    }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        set_record(r, rec.t, rec);
+    }
+    void set_record(const ray& r, float t, hit_record& rec) const
+    {
+        float y = r.origin().y() + t * r.direction().y();
+        float z = r.origin().z() + t * r.direction().z();
         rec.u = (y - y0) / (y1 - y0);
         rec.v = (z - z0) / (z1 - z0);
         rec.t = t;
         rec.mat_ptr = mp;
         rec.p = r.point_at_parameter(t);
         rec.normal = vec3(1, 0, 0);
-        return true;
+    }
+    virtual bool occluded(const ray& r, float t0, float t1) const
+    {
+        return rect_occluded(0, k, y0, y1, z0, z1, r, t0, t1);
+    }
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const
+    {
+        return rect_sample_light(0, k, y0, y1, z0, z1, mp, o, smp, ls);
+    }
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const
+    {
+        return rect_light_pdf(0, k, y0, y1, z0, z1, o, d, t);
     }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
@@ -108,15 +274,44 @@ public:
     {
         if(ptr->hit(r, t0, t1, rec))
         {
-            rec.normal = -rec.normal;
+            push_instance(this, r, rec);
             return true;
         }
         else return false;
     }
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+    {
+        int hits = ptr->hit_packet(p, mask, t_min, recs);
+        for(int k = 0; k < simd_width; ++k)
+            if(hits >> k & 1) push_instance(this, p.get(k), recs[k]);
+        return hits;
+    }
+    virtual void to_world(hit_record& rec) const
+    {
+        rec.normal = -rec.normal;
+    }
+    virtual bool occluded(const ray& r, float t0, float t1) const
+    {
+        return ptr->occluded(r, t0, t1);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return ptr->interval(r, t_enter, t_exit);
+    }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
         return ptr->bounding_box(t0, t1, box);;
     }
+    virtual bool animated() const { return ptr->animated(); }
+    virtual void refit(float t0, float t1) { ptr->refit(t0, t1); }
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const
+    {
+        return ptr->sample_light(o, smp, ls);
+    }
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const
+    {
+        return ptr->light_pdf(o, d, t);
+    }
     hitable* ptr;
 };
 #endif
\ No newline at end of file
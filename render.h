@@ -0,0 +1,143 @@
+// tile based multithreaded renderer
+#ifndef RENDER_H
+#define RENDER_H
+
+#include "hitable.h"
+#include "material.h"
+#include "camera.h"
+#include "thread_pool.h"
+#include "integrator.h"
+#include "framebuffer.h"
+#include "render_settings.h"
+#include "wavefront.h"
+#include <vector>
+#include <algorithm>
+#include <atomic>
+#include <chrono>
+#include <float.h>
+
+struct render_stats
+{
+    uint64_t paths = 0;
+    uint64_t segments = 0;
+    double seconds = 0;
+};
+
+// every sample restarts the worker's sampler at (pixel, sample), so the image
+// is the same for any thread count or tile size
+inline void render_tile(const tile& t, const camera& cam, hitable* world, const render_settings& settings, framebuffer& fb)
+{
+    sampler& smp = thread_sampler();
+    smp = sampler(settings.sampling);
+    for(int j = t.y0; j < t.y1; ++j)
+        for(int i = t.x0; i < t.x1; ++i) {
+            vec3 col(0);
+            uint64_t pixel = uint64_t(j) * fb.nx + i;
+            if(!settings.sampled(pixel)) continue;
+            int first = settings.first(pixel);
+            for(int s = first; s < first + settings.ns; ++s)
+            {
+                smp.start(pixel, s, settings.seed);
+                float du, dv;
+                smp.get_2d(du, dv);
+                ray r = cam.get_ray(float(i + du) / float(fb.nx), float(j + dv) / float(fb.ny), smp);
+                col += trace_path(r, world, settings.path, smp);
+            }
+            fb.at(i, j) = col / float(settings.ns);
+        }
+}
+
+// camera rays of (simd_width / 2) x 2 pixel blocks are traced as one packet,
+// every lane then continues on its own from its first hit. lanes draw the same
+// numbers as render_tile, so scenes without media render identically.
+inline void render_tile_packets(const tile& t, const camera& cam, hitable* world, const render_settings& settings, framebuffer& fb)
+{
+    const int bw = simd_width / 2, bh = 2;
+    sampler smp[simd_width];
+    for(int k = 0; k < simd_width; ++k) smp[k] = sampler(settings.sampling);
+    float u[simd_width], v[simd_width];
+    hit_record recs[simd_width];
+    ray_packet p;
+    for(int y = t.y0; y < t.y1; y += bh)
+        for(int x = t.x0; x < t.x1; x += bw)
+        {
+            int mask = 0;
+            vec3 col[simd_width];
+            for(int k = 0; k < simd_width; ++k)
+            {
+                col[k] = vec3(0);
+                int i = x + k % bw, j = y + k / bw;
+                if(i < t.x1 && j < t.y1 && settings.sampled(size_t(j) * fb.nx + i)) mask |= 1 << k;
+            }
+            if(!mask) continue;
+            for(int s = 0; s < settings.ns; ++s)
+            {
+                for(int k = 0; k < simd_width; ++k)
+                {
+                    if(!(mask >> k & 1)) continue;
+                    int i = x + k % bw, j = y + k / bw;
+                    uint64_t pixel = uint64_t(j) * fb.nx + i;
+                    smp[k].start(pixel, settings.first(pixel) + s, settings.seed);
+                    float du, dv;
+                    smp[k].get_2d(du, dv);
+                    u[k] = float(i + du) / float(fb.nx);
+                    v[k] = float(j + dv) / float(fb.ny);
+                }
+                cam.get_packet(u, v, smp, mask, p);
+                int hits = world->hit_packet(p, mask, 0.001, recs);
+                for(int k = 0; k < simd_width; ++k)
+                {
+                    if(!(mask >> k & 1)) continue;
+                    media_sampler() = &smp[k];
+                    ray r = p.get(k);
+                    if(hits >> k & 1)
+                    {
+                        finish_hit(r, recs[k]);
+                        col[k] += trace_from_hit(r, recs[k], world, settings.path, smp[k]);
+                    }
+                    else {
+                        col[k] += background(r);
+                        ++thread_path_counters().paths;
+                        ++thread_path_counters().segments;
+                    }
+                }
+            }
+            for(int k = 0; k < simd_width; ++k)
+                if(mask >> k & 1)
+                    fb.at(x + k % bw, y + k / bw) = col[k] / float(settings.ns);
+        }
+    media_sampler() = &thread_sampler();
+}
+
+// the world is read-only while rendering, so every worker shares it.
+// tiles write disjoint pixels of fb and need no locking.
+inline void render(const camera& cam, hitable* world, const render_settings& settings, framebuffer& fb,
+                   render_stats* stats = nullptr)
+{
+    auto start = std::chrono::steady_clock::now();
+    std::atomic<uint64_t> paths(0), segments(0);
+    thread_pool pool(settings.threads);
+    std::vector<tile> tiles = make_tiles(fb.nx, fb.ny, settings.tile_size);
+    for(const tile& t : tiles)
+        pool.submit([&cam, world, &settings, &fb, &paths, &segments, t] {
+            path_counters before = thread_path_counters();
+            switch(settings.mode)
+            {
+            case MODE_PACKETS: render_tile_packets(t, cam, world, settings, fb); break;
+            case MODE_WAVEFRONT: render_tile_wavefront(t, cam, world, settings, fb); break;
+            default: render_tile(t, cam, world, settings, fb);
+            }
+            paths += thread_path_counters().paths - before.paths;
+            segments += thread_path_counters().segments - before.segments;
+        });
+    pool.wait();
+    if(stats)
+    {
+        std::chrono::duration<double> elapsed = std::chrono::steady_clock::now() - start;
+        stats->paths = paths;
+        stats->segments = segments;
+        stats->seconds = elapsed.count();
+    }
+}
+
+#endif
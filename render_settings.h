@@ -0,0 +1,49 @@
+// what a render pass traces
+#ifndef RENDER_SETTINGS_H
+#define RENDER_SETTINGS_H
+
+#include "integrator.h"
+#include "sampler.h"
+#include <stdint.h>
+#include <stddef.h>
+#include <string>
+
+enum render_mode
+{
+    MODE_PATH,      // one path at a time, render_tile
+    MODE_PACKETS,   // camera rays in packets, render_tile_packets
+    MODE_WAVEFRONT  // batches of paths sorted by material, render_tile_wavefront
+};
+
+const char* const render_mode_names[] = {"path", "packets", "wavefront"};
+
+inline bool parse_render_mode(const std::string& name, render_mode& m)
+{
+    for(int i = 0; i <= MODE_WAVEFRONT; ++i)
+        if(name == render_mode_names[i])
+        {
+            m = render_mode(i);
+            return true;
+        }
+    return false;
+}
+
+struct render_settings
+{
+    int ns = 30;
+    int first_sample = 0; // sample indices first_sample .. first_sample + ns - 1 are traced
+    // per pixel overrides for progressive passes, null : every pixel from first_sample
+    const uint32_t* pixel_first = nullptr; // first sample index of each pixel
+    const uint8_t* active = nullptr;       // pixels that get samples in this pass
+    int tile_size = 16;
+    int threads = 0; // 0 : one per hardware thread
+    uint64_t seed = 0;
+    render_mode mode = MODE_PATH;
+    sampler_kind sampling = SAMPLER_SOBOL;
+    path_settings path;
+
+    bool sampled(size_t pixel) const { return !active || active[pixel]; }
+    int first(size_t pixel) const { return pixel_first ? int(pixel_first[pixel]) : first_sample; }
+};
+
+#endif
@@ -0,0 +1,236 @@
+// sample values for the dimensions of a path: pixel, lens, time and bounces
+#ifndef SAMPLER_H
+#define SAMPLER_H
+
+#include "rand.h"
+#include <math.h>
+#include <stdint.h>
+#include <string>
+
+enum sampler_kind
+{
+    SAMPLER_INDEPENDENT, // every value from pcg32
+    SAMPLER_SOBOL        // scrambled sobol points, stratified across the samples of a pixel
+};
+
+const char* const sampler_names[] = {"random", "sobol"};
+
+inline bool parse_sampler(const std::string& name, sampler_kind& k)
+{
+    for(int i = 0; i <= SAMPLER_SOBOL; ++i)
+        if(name == sampler_names[i])
+        {
+            k = sampler_kind(i);
+            return true;
+        }
+    return false;
+}
+
+//sobol---------------------------------------------------------------------------------------
+inline uint32_t reverse_bits(uint32_t x)
+{
+    x = __builtin_bswap32(x);
+    x = ((x & 0x0f0f0f0fu) << 4) | ((x & 0xf0f0f0f0u) >> 4);
+    x = ((x & 0x33333333u) << 2) | ((x & 0xccccccccu) >> 2);
+    x = ((x & 0x55555555u) << 1) | ((x & 0xaaaaaaaau) >> 1);
+    return x;
+}
+
+// the second sobol dimension is the xor of the generator matrix columns of
+// the set bits of the index. scrambled indices use all 32 bits, so the
+// columns are combined a byte at a time from tables. they hold the columns
+// bit reversed, which is the order the scrambling works in.
+struct sobol_table
+{
+    sobol_table()
+    {
+        uint32_t column[32];
+        column[0] = 1u << 31;
+        for(int i = 1; i < 32; ++i) column[i] = column[i - 1] ^ (column[i - 1] >> 1);
+        for(int byte = 0; byte < 4; ++byte)
+            for(int k = 0; k < 256; ++k)
+            {
+                uint32_t y = 0;
+                for(int i = 0; i < 8; ++i)
+                    if(k >> i & 1) y ^= column[8 * byte + i];
+                bytes[byte][k] = reverse_bits(y);
+            }
+    }
+    uint32_t bytes[4][256];
+};
+
+// the second sobol dimension of index, bit reversed. the first one is the
+// van der Corput sequence, reverse_bits(index).
+inline uint32_t sobol_reversed_y(uint32_t index)
+{
+    static const sobol_table table;
+    return table.bytes[0][index & 255] ^ table.bytes[1][index >> 8 & 255]
+         ^ table.bytes[2][index >> 16 & 255] ^ table.bytes[3][index >> 24];
+}
+
+// Owen scrambling by hashing (Laine and Karras 2011, constants of Burley
+// 2020) of a bit reversed value: every bit is flipped depending only on the
+// bits below it, the ones above it before the reversal, so the points stay
+// stratified while every pixel gets its own random pattern
+inline uint32_t laine_karras_permutation(uint32_t x, uint32_t seed)
+{
+    x += seed;
+    x ^= x * 0x6c50b47cu;
+    x ^= x * 0xb82f1e52u;
+    x ^= x * 0xc7afe638u;
+    x ^= x * 0x8d22f6e6u;
+    return x;
+}
+
+inline float to_unit_float(uint32_t x)
+{
+    return float(x >> 8) * (1.0f / 16777216.0f);
+}
+
+//sampler-------------------------------------------------------------------------------------
+// a path asks for its values in a fixed order: the camera takes dimensions
+// [0, camera_dimensions), bounce d the next bounce_dimensions from
+// start_bounce(d) on. every dimension is a 2d sobol point of its own,
+// shuffled and scrambled per pixel and dimension (Burley 2020), so the pairs
+// that warps use together are stratified together. values asked beyond a
+// bounce's share, or past max_dimensions, come from pcg32.
+class sampler
+{
+public:
+    static const int camera_dimensions = 4;  // pixel, lens, time, a medium on the camera ray
+    static const int bounce_dimensions = 8;  // light choice and point, scattering, roulette, media
+    static const int max_dimensions = camera_dimensions + 16 * bounce_dimensions;
+
+    sampler(sampler_kind k = SAMPLER_INDEPENDENT) : kind(k) {}
+
+    // sample `sample` of pixel `pixel`. rng is seeded from the same triple, so
+    // every sample is an independent sequence for any tile or thread order.
+    void start(uint64_t pixel, uint64_t sample, uint64_t base = 0)
+    {
+        rng.seed_sample(pixel, sample, base);
+        pixel_seed = hash64(hash64(base) ^ pixel);
+        index = uint32_t(sample);
+        dimension = 0;
+        end = kind == SAMPLER_SOBOL ? camera_dimensions : 0;
+    }
+    void start_bounce(int depth)
+    {
+        if(kind != SAMPLER_SOBOL) return;
+        dimension = camera_dimensions + depth * bounce_dimensions;
+        end = dimension + bounce_dimensions;
+        if(end > max_dimensions) end = 0;
+    }
+
+    float get_1d()
+    {
+        if(dimension >= end) return random(rng);
+        uint32_t seeds[3];
+        uint32_t s = shuffled_index(seeds);
+        return to_unit_float(reverse_bits(laine_karras_permutation(s, seeds[1])));
+    }
+    void get_2d(float& u, float& v)
+    {
+        if(dimension >= end)
+        {
+            u = random(rng);
+            v = random(rng);
+            return;
+        }
+        uint32_t seeds[3];
+        uint32_t s = shuffled_index(seeds);
+        u = to_unit_float(reverse_bits(laine_karras_permutation(s, seeds[1])));
+        v = to_unit_float(reverse_bits(laine_karras_permutation(sobol_reversed_y(s), seeds[2])));
+    }
+
+    sampler_kind kind;
+    pcg32 rng;
+
+private:
+    // the sample index of this pixel and dimension, an owen scrambled
+    // permutation of index. seeds[1] and [2] then scramble the two values.
+    // (the van der Corput value of s is reverse_bits(s), and scrambling it
+    // undoes that reversal, so the x value needs no table.)
+    uint32_t shuffled_index(uint32_t seeds[3])
+    {
+        uint64_t h = hash64(pixel_seed + dimension++);
+        seeds[0] = uint32_t(h);
+        seeds[1] = uint32_t(h >> 32);
+        seeds[2] = uint32_t(hash64(h) >> 32);
+        return reverse_bits(laine_karras_permutation(reverse_bits(index), seeds[0]));
+    }
+
+    uint64_t pixel_seed = 0;
+    uint32_t index = 0;
+    int dimension = 0;
+    int end = 0;
+};
+
+// sampler of the calling thread's current path in render_tile
+inline sampler& thread_sampler()
+{
+    static thread_local sampler s;
+    return s;
+}
+
+// what code reached through hit() draws from, having no sampler at hand
+// (media). renderers that keep a sampler per path point it at the one of
+// the path they trace.
+inline sampler*& media_sampler()
+{
+    static thread_local sampler* s = &thread_sampler();
+    return s;
+}
+
+//warps---------------------------------------------------------------------------------------
+// they map uniform values to the shapes the rejection loops of rand.h drew,
+// one to one, so stratified values stay stratified
+
+// concentric map of the square to the unit disk (Shirley and Chiu 1997)
+inline vec3 warp_disk(float u, float v)
+{
+    float a = 2 * u - 1, b = 2 * v - 1;
+    if(a == 0 && b == 0) return vec3(0);
+    float r, phi;
+    if(fabsf(a) > fabsf(b))
+    {
+        r = a;
+        phi = float(M_PI / 4) * (b / a);
+    }
+    else {
+        r = b;
+        phi = float(M_PI / 2) - float(M_PI / 4) * (a / b);
+    }
+    return vec3(r * cosf(phi), r * sinf(phi), 0);
+}
+
+// uniform direction
+inline vec3 warp_sphere(float u, float v)
+{
+    float z = 1 - 2 * u;
+    float r = sqrtf(fmaxf(0.0f, 1 - z * z));
+    float phi = float(2 * M_PI) * v;
+    return vec3(r * cosf(phi), r * sinf(phi), z);
+}
+
+// uniform point inside the unit sphere
+inline vec3 warp_ball(float u, float v, float w)
+{
+    return cbrtf(w) * warp_sphere(u, v);
+}
+
+// cosine distributed direction around +z, Malley's method on warp_disk
+inline vec3 warp_cosine_hemisphere(float u, float v)
+{
+    vec3 d = warp_disk(u, v);
+    return vec3(d.x(), d.y(), sqrtf(fmaxf(0.0f, 1 - d.x() * d.x() - d.y() * d.y())));
+}
+
+// unit vectors u, v completing w to an orthonormal basis
+inline void make_basis(const vec3& w, vec3& u, vec3& v)
+{
+    vec3 a = fabsf(w.x()) > 0.9f ? vec3(0, 1, 0) : vec3(1, 0, 0);
+    v = unit_vector(cross(w, a));
+    u = cross(w, v);
+}
+
+#endif
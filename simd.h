@@ -0,0 +1,108 @@
+// float lanes for the packet kernels: 8 wide with avx, 4 wide with sse
+#ifndef SIMD_H
+#define SIMD_H
+
+#include <math.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+#if defined(__AVX__)
+
+const int simd_width = 8;
+
+struct vfloat
+{
+    vfloat() = default;
+    vfloat(__m256 a) : v(a) {}
+    vfloat(float a) : v(_mm256_set1_ps(a)) {}
+    static vfloat load(const float* p) { return _mm256_load_ps(p); }
+    void store(float* p) const { _mm256_store_ps(p, v); }
+    __m256 v;
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm256_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm256_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm256_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm256_div_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LT_OQ); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GT_OQ); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_LE_OQ); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm256_cmp_ps(a.v, b.v, _CMP_GE_OQ); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm256_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm256_or_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm256_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm256_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm256_sqrt_ps(a.v); }
+// m ? a : b, lane by lane
+inline vfloat select(vfloat m, vfloat a, vfloat b) { return _mm256_blendv_ps(b.v, a.v, m.v); }
+inline int movemask(vfloat m) { return _mm256_movemask_ps(m.v); }
+
+#elif defined(__SSE2__) || defined(_M_X64)
+
+const int simd_width = 4;
+
+struct vfloat
+{
+    vfloat() = default;
+    vfloat(__m128 a) : v(a) {}
+    vfloat(float a) : v(_mm_set1_ps(a)) {}
+    static vfloat load(const float* p) { return _mm_load_ps(p); }
+    void store(float* p) const { _mm_store_ps(p, v); }
+    __m128 v;
+};
+
+inline vfloat operator+(vfloat a, vfloat b) { return _mm_add_ps(a.v, b.v); }
+inline vfloat operator-(vfloat a, vfloat b) { return _mm_sub_ps(a.v, b.v); }
+inline vfloat operator*(vfloat a, vfloat b) { return _mm_mul_ps(a.v, b.v); }
+inline vfloat operator/(vfloat a, vfloat b) { return _mm_div_ps(a.v, b.v); }
+inline vfloat operator<(vfloat a, vfloat b) { return _mm_cmplt_ps(a.v, b.v); }
+inline vfloat operator>(vfloat a, vfloat b) { return _mm_cmpgt_ps(a.v, b.v); }
+inline vfloat operator<=(vfloat a, vfloat b) { return _mm_cmple_ps(a.v, b.v); }
+inline vfloat operator>=(vfloat a, vfloat b) { return _mm_cmpge_ps(a.v, b.v); }
+inline vfloat operator&(vfloat a, vfloat b) { return _mm_and_ps(a.v, b.v); }
+inline vfloat operator|(vfloat a, vfloat b) { return _mm_or_ps(a.v, b.v); }
+inline vfloat vmin(vfloat a, vfloat b) { return _mm_min_ps(a.v, b.v); }
+inline vfloat vmax(vfloat a, vfloat b) { return _mm_max_ps(a.v, b.v); }
+inline vfloat vsqrt(vfloat a) { return _mm_sqrt_ps(a.v); }
+inline vfloat select(vfloat m, vfloat a, vfloat b) { return _mm_or_ps(_mm_and_ps(m.v, a.v), _mm_andnot_ps(m.v, b.v)); }
+inline int movemask(vfloat m) { return _mm_movemask_ps(m.v); }
+
+#else
+
+// plain loops, masks are all-ones / zero bit patterns like the intrinsics
+const int simd_width = 4;
+
+struct vfloat
+{
+    vfloat() = default;
+    vfloat(float a) { for(int k = 0; k < 4; ++k) v[k] = a; }
+    static vfloat load(const float* p) { vfloat r; for(int k = 0; k < 4; ++k) r.v[k] = p[k]; return r; }
+    void store(float* p) const { for(int k = 0; k < 4; ++k) p[k] = v[k]; }
+    float v[4];
+};
+
+inline float mask_lane(bool b) { union { unsigned u; float f; } x; x.u = b ? ~0u : 0u; return x.f; }
+inline bool lane_set(float f) { union { float f; unsigned u; } x; x.f = f; return x.u != 0; }
+
+#define VFLOAT_LANES(expr) vfloat r; for(int k = 0; k < 4; ++k) r.v[k] = (expr); return r;
+inline vfloat operator+(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] + b.v[k]) }
+inline vfloat operator-(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] - b.v[k]) }
+inline vfloat operator*(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] * b.v[k]) }
+inline vfloat operator/(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] / b.v[k]) }
+inline vfloat operator<(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(a.v[k] < b.v[k])) }
+inline vfloat operator>(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(a.v[k] > b.v[k])) }
+inline vfloat operator<=(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(a.v[k] <= b.v[k])) }
+inline vfloat operator>=(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(a.v[k] >= b.v[k])) }
+inline vfloat operator&(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(lane_set(a.v[k]) && lane_set(b.v[k]))) }
+inline vfloat operator|(vfloat a, vfloat b) { VFLOAT_LANES(mask_lane(lane_set(a.v[k]) || lane_set(b.v[k]))) }
+inline vfloat vmin(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] < b.v[k] ? a.v[k] : b.v[k]) }
+inline vfloat vmax(vfloat a, vfloat b) { VFLOAT_LANES(a.v[k] > b.v[k] ? a.v[k] : b.v[k]) }
+inline vfloat vsqrt(vfloat a) { VFLOAT_LANES(sqrtf(a.v[k])) }
+inline vfloat select(vfloat m, vfloat a, vfloat b) { VFLOAT_LANES(lane_set(m.v[k]) ? a.v[k] : b.v[k]) }
+inline int movemask(vfloat m) { int r = 0; for(int k = 0; k < 4; ++k) r |= lane_set(m.v[k]) << k; return r; }
+#undef VFLOAT_LANES
+
+#endif
+
+#endif
@@ -13,6 +13,29 @@ inline void get_sphere_uv(const vec3& p, float& u, float& v)
     v = (theta + M_PI / 2) / M_PI;
 }
 
+// both roots of the ray's line with the sphere, t0 <= t1
+inline bool sphere_interval(const vec3& center, float radius, const ray& r, float& t0, float& t1)
+{
+    vec3 oc = r.origin() - center;
+    float a = dot(r.direction(), r.direction());
+    float b = dot(oc, r.direction());
+    float c = dot(oc, oc) - radius * radius;
+    float discriminant = b * b - a * c;
+    if(discriminant <= 0) return false;
+    float root = sqrt(discriminant);
+    t0 = (-b - root) / a;
+    t1 = (-b + root) / a;
+    return true;
+}
+
+// either root of the quadratic of sphere::hit in (t_min, t_max)
+inline bool sphere_occluded(const vec3& center, float radius, const ray& r, float t_min, float t_max)
+{
+    float t0, t1;
+    if(!sphere_interval(center, radius, r, t0, t1)) return false;
+    return (t0 < t_max && t0 > t_min) || (t1 < t_max && t1 > t_min);
+}
+
 //sphere-------------------------------------------------------------------------------------
 class sphere: public hitable
 {
@@ -21,6 +44,29 @@ public:
     sphere(vec3 cen, float r, material* mat): center(cen), radius(r), mat_ptr(mat) {}
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
     virtual bool bounding_box(float t0, float t1, aabb& box) const;
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        return sphere_occluded(center, radius, r, t_min, t_max);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return sphere_interval(center, radius, r, t_enter, t_exit);
+    }
+    virtual bool sample_light(const vec3& o, sampler& smp, light_sample& ls) const;
+    virtual float light_pdf(const vec3& o, const vec3& d, float& t) const;
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        set_record(r, rec.t, rec);
+    }
+    void set_record(const ray& r, float t, hit_record& rec) const
+    {
+        rec.t = t;
+        rec.p = r.point_at_parameter(rec.t);
+        rec.normal = (rec.p - center) / radius;
+        get_sphere_uv(rec.normal, rec.u, rec.v);
+        rec.mat_ptr = mat_ptr;
+    }
 
     vec3 center;
     float radius;
@@ -39,32 +85,106 @@ inline bool sphere::hit(const ray& r, float t_min, float t_max, hit_record& rec)
         float temp = (-b - sqrt(discriminant)) / a;
         if(temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = r.point_at_parameter(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            get_sphere_uv(rec.normal, rec.u, rec.v);
-            rec.mat_ptr = mat_ptr;
+            record_hit(rec, temp, this);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / a;
         if(temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = r.point_at_parameter(rec.t);
-            rec.normal = (rec.p - center) / radius;
-            get_sphere_uv(rec.normal, rec.u, rec.v);
-            rec.mat_ptr = mat_ptr;
+            record_hit(rec, temp, this);
             return true;
         }
     }
     return false;
 }
 
+// same quadratic as sphere::hit on every lane, centers given per lane.
+// returns the lanes of mask that hit and writes their distance to t.
+inline int sphere_packet_hit(const ray_packet& p, int mask, float t_min, vfloat cx, vfloat cy, vfloat cz, float radius, float* t)
+{
+    vfloat dx = vfloat::load(p.dx), dy = vfloat::load(p.dy), dz = vfloat::load(p.dz);
+    vfloat ocx = vfloat::load(p.ox) - cx;
+    vfloat ocy = vfloat::load(p.oy) - cy;
+    vfloat ocz = vfloat::load(p.oz) - cz;
+    vfloat a = dx * dx + dy * dy + dz * dz;
+    vfloat b = ocx * dx + ocy * dy + ocz * dz;
+    vfloat c = ocx * ocx + ocy * ocy + ocz * ocz - vfloat(radius * radius);
+    vfloat discriminant = b * b - a * c;
+    vfloat root = vsqrt(vmax(discriminant, vfloat(0)));
+    vfloat t_max = vfloat::load(p.t_max);
+    vfloat t0 = (vfloat(0) - b - root) / a;
+    vfloat t1 = (vfloat(0) - b + root) / a;
+    vfloat hit0 = (discriminant > vfloat(0)) & (t0 < t_max) & (t0 > vfloat(t_min));
+    vfloat hit1 = (discriminant > vfloat(0)) & (t1 < t_max) & (t1 > vfloat(t_min));
+    select(hit0, t0, t1).store(t);
+    return movemask(hit0 | hit1) & mask;
+}
+
+// fills recs for the lanes returned by sphere_packet_hit
+template <class S>
+inline int sphere_packet_records(const S& s, ray_packet& p, int hits, const float* t, hit_record* recs)
+{
+    for(int k = 0; k < simd_width; ++k)
+        if(hits >> k & 1)
+        {
+            p.t_max[k] = t[k];
+            record_hit(recs[k], t[k], &s);
+        }
+    return hits;
+}
+
+inline int sphere::hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+{
+    alignas(32) float t[simd_width];
+    int hits = sphere_packet_hit(p, mask, t_min, center.x(), center.y(), center.z(), radius, t);
+    return hits ? sphere_packet_records(*this, p, hits, t, recs) : 0;
+}
+
 inline bool sphere::bounding_box(float t0, float t1, aabb& box) const
 {
     box = aabb(center - vec3(radius), center + vec3(radius));
     return true;
 }
+
+// uniform over the cone of directions from o that hit the sphere, which only
+// covers its visible side. not defined from inside.
+inline bool sphere::sample_light(const vec3& o, sampler& smp, light_sample& ls) const
+{
+    vec3 oc = center - o;
+    float d2 = oc.squared_length();
+    float r2 = radius * radius;
+    if(d2 <= r2) return false;
+    float cos_max = sqrtf(1 - r2 / d2);
+    float s1, s2;
+    smp.get_2d(s1, s2);
+    float z = 1 + s1 * (cos_max - 1);
+    float phi = 2 * M_PI * s2;
+    float sin_z = sqrtf(std::max(0.0f, 1 - z * z));
+    vec3 w = oc / sqrtf(d2), u, v;
+    make_basis(w, u, v);
+    ls.wi = unit_vector(cosf(phi) * sin_z * u + sinf(phi) * sin_z * v + z * w);
+    float b = dot(oc, ls.wi);
+    ls.dist = b - sqrtf(std::max(0.0f, b * b - d2 + r2));
+    ls.pdf = 1 / (2 * M_PI * (1 - cos_max));
+    vec3 p = o + ls.dist * ls.wi;
+    float pu, pv;
+    get_sphere_uv((p - center) / radius, pu, pv);
+    ls.emitted = emission(mat_ptr->record(), pu, pv, p);
+    return true;
+}
+
+inline float sphere::light_pdf(const vec3& o, const vec3& d, float& t) const
+{
+    vec3 oc = center - o;
+    float d2 = oc.squared_length();
+    float r2 = radius * radius;
+    if(d2 <= r2) return 0;
+    float b = dot(oc, d);
+    float disc = b * b - d2 + r2;
+    if(b <= 0 || disc < 0) return 0;
+    t = b - sqrtf(disc);
+    return 1 / (2 * M_PI * (1 - sqrtf(1 - r2 / d2)));
+}
 //moving_sphere------------------------------------------------------------------------------
 class moving_sphere : public hitable
 {
@@ -74,7 +194,28 @@ public:
         center0(cen0), center1(cen1), time0(t0), time1(t1), radius(r), mat_ptr(m) {}
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
     virtual bool bounding_box(float t0, float t1, aabb& box) const;
-
+    virtual int hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const
+    {
+        return sphere_occluded(center(r.time()), radius, r, t_min, t_max);
+    }
+    virtual bool interval(const ray& r, float& t_enter, float& t_exit) const
+    {
+        return sphere_interval(center(r.time()), radius, r, t_enter, t_exit);
+    }
+    virtual bool animated() const { return true; }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        set_record(r, rec.t, rec);
+    }
+    void set_record(const ray& r, float t, hit_record& rec) const
+    {
+        rec.t = t;
+        rec.p = r.point_at_parameter(rec.t);
+        rec.normal = (rec.p - center(r.time())) / radius;
+        get_sphere_uv(rec.normal, rec.u, rec.v);
+        rec.mat_ptr = mat_ptr;
+    }
 
     vec3 center(float time) const 
     {
@@ -98,31 +239,39 @@ inline bool moving_sphere::hit(const ray& r, float t_min, float t_max, hit_recor
         float temp = (-b - sqrt(discriminant)) / a;
         if(temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = r.point_at_parameter(rec.t);
-            rec.normal = (rec.p - center(r.time())) / radius;
-            get_sphere_uv(rec.normal, rec.u, rec.v);
-            rec.mat_ptr = mat_ptr;
+            record_hit(rec, temp, this);
             return true;
         }
         temp = (-b + sqrt(discriminant)) / a;
         if(temp < t_max && temp > t_min)
         {
-            rec.t = temp;
-            rec.p = r.point_at_parameter(rec.t);
-            rec.normal = (rec.p - center(r.time())) / radius;
-            get_sphere_uv(rec.normal, rec.u, rec.v);
-            rec.mat_ptr = mat_ptr;
+            record_hit(rec, temp, this);
             return true;
         }
     }
     return false;
 }
 
+inline int moving_sphere::hit_packet(ray_packet& p, int mask, float t_min, hit_record* recs) const
+{
+    vfloat s = (vfloat::load(p.time) - vfloat(time0)) / vfloat(time1 - time0);
+    vfloat cx = vfloat(center0.x()) + s * vfloat(center1.x() - center0.x());
+    vfloat cy = vfloat(center0.y()) + s * vfloat(center1.y() - center0.y());
+    vfloat cz = vfloat(center0.z()) + s * vfloat(center1.z() - center0.z());
+    alignas(32) float t[simd_width];
+    int hits = sphere_packet_hit(p, mask, t_min, cx, cy, cz, radius, t);
+    return hits ? sphere_packet_records(*this, p, hits, t, recs) : 0;
+}
+
+// the center moves on a line, also before time0 and after time1, so the
+// spheres at t0 and t1 bound the motion. the ends of [time0, time1] are
+// taken as given rather than recomputed.
 inline bool moving_sphere::bounding_box(float t0, float t1, aabb& box) const
 {
-    aabb box0(center0 - vec3(radius), center0 + vec3(radius));
-    aabb box1(center1 - vec3(radius), center1 + vec3(radius));
+    vec3 c0 = t0 == time0 ? center0 : center(t0);
+    vec3 c1 = t1 == time1 ? center1 : center(t1);
+    aabb box0(c0 - vec3(radius), c0 + vec3(radius));
+    aabb box1(c1 - vec3(radius), c1 + vec3(radius));
     box = surrounding_box(box0, box1);
     return true;
 }
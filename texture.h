@@ -3,73 +3,132 @@
 
 #include "ray.h"
 #include "perlin.h"
+#include <vector>
 
+//texture table-------------------------------------------------------------------------------
+// every texture of the scene as a tagged record in one array, evaluated with a
+// switch instead of a virtual call per lookup
+enum texture_kind
+{
+    TEX_CONSTANT,
+    TEX_CHECKER,
+    TEX_NOISE,
+    TEX_IMAGE
+};
+
+struct texture_record
+{
+    texture_kind kind = TEX_CONSTANT;
+    vec3 color = vec3(0);   // constant
+    int even = 0, odd = 0;  // checker : ids of the two textures
+    float scale = 1;        // noise
+    const unsigned char* data = nullptr; // image : rgb bytes
+    int nx = 0, ny = 0;
+};
+
+class texture_table
+{
+public:
+    int add(const texture_record& t)
+    {
+        records.push_back(t);
+        return int(records.size()) - 1;
+    }
+    const texture_record& operator[](int id) const { return records[id]; }
+    void clear() { records.clear(); }
+
+    std::vector<texture_record> records;
+};
+
+// textures of the scene being built, cleared with it
+texture_table scene_textures;
+
+inline vec3 texture_value(int id, float u, float v, const vec3& p)
+{
+    const texture_record* t = &scene_textures[id];
+    while(t->kind == TEX_CHECKER)
+    {
+        float sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
+        t = &scene_textures[sines < 0 ? t->odd : t->even];
+    }
+    switch(t->kind)
+    {
+    case TEX_NOISE:
+        //return vec3(perlin().noise(t->scale * p));
+        return vec3(0.5 * (1 + sin(t->scale * p.x() + 10 * perlin().turb(p)))); //marble
+        //return vec3(perlin().turb(t->scale * p));
+    case TEX_IMAGE:
+    {
+        int i = u * t->nx;
+        int j = (1 - v) * t->ny - 0.001;
+        i = i < 0 ? 0 : (i > t->nx - 1 ? t->nx - 1 : i);
+        j = j < 0 ? 0 : (j > t->ny - 1 ? t->ny - 1 : j);
+
+        const unsigned char* texel = t->data + 3 * i + 3 * t->nx * j;
+        return vec3(int(texel[0]) / 255.0, int(texel[1]) / 255.0, int(texel[2]) / 255.0);
+    }
+    default:
+        return t->color;
+    }
+}
+
+//textures------------------------------------------------------------------------------------
+// what the scene functions build; each one only registers its record
 class texture
 {
 public:
-    virtual vec3 value(float u, float v, const vec3& p) const = 0;
+    vec3 value(float u, float v, const vec3& p) const { return texture_value(id, u, v, p); }
+    bool is_constant() const { return scene_textures[id].kind == TEX_CONSTANT; }
+    int id = 0;
 };
 
 class constant_texture : public texture
 {
 public:
-    constant_texture() = default;
-    constant_texture(vec3 c) : color(c) {}
-    virtual vec3 value(float u, float v, const vec3& p) const
+    constant_texture(vec3 c)
     {
-        return color;
+        texture_record t;
+        t.color = c;
+        id = scene_textures.add(t);
     }
-    vec3 color;
 };
 
 class checker_texture : public texture
 {
 public:
-    checker_texture() = default;
-    checker_texture(texture* t0, texture* t1) : even(t0), odd(t1) {}
-    virtual vec3 value(float u, float v, const vec3& p) const
+    checker_texture(texture* t0, texture* t1)
     {
-        float sines = sin(10 * p.x()) * sin(10 * p.y()) * sin(10 * p.z());
-        if(sines < 0) return odd->value(u, v, p);
-        else return even->value(u, v, p);
+        texture_record t;
+        t.kind = TEX_CHECKER;
+        t.even = t0->id;
+        t.odd = t1->id;
+        id = scene_textures.add(t);
     }
-    texture* odd;
-    texture* even;
 };
 
 class noise_texture : public texture
 {
 public:
-    noise_texture() = default;
-    noise_texture(float sc) : scale(sc) {}
-    virtual vec3 value(float u, float v, const vec3& p) const
+    noise_texture(float sc = 1)
     {
-        //return vec3(noise.noise(scale * p));
-        return vec3(0.5 * (1 + sin(scale * p.x() + 10 * noise.turb(p)))); //marble
-        //return vec3(noise.turb(scale * p));
+        texture_record t;
+        t.kind = TEX_NOISE;
+        t.scale = sc;
+        id = scene_textures.add(t);
     }
-    perlin noise;
-    float scale = 1;
 };
 
 class image_texture : public texture
 {
 public:
-    image_texture() = default;
-    image_texture(unsigned char* pixels, int A, int B) : data(pixels), nx(A), ny(B) {}
-    virtual vec3 value(float u, float v, const vec3& p) const
+    image_texture(unsigned char* pixels, int A, int B)
     {
-        int i = u * nx;
-        int j = (1 - v) * ny - 0.001;
-        i = i < 0 ? 0 : (i > nx - 1 ? nx - 1 : i);
-        j = j < 0 ? 0 : (j > ny - 1 ? ny - 1 : j);
-
-        float r = int(data[3 * i + 3 * nx * j]) / 255.0;
-        float g = int(data[3 * i + 3 * nx * j + 1]) / 255.0;
-        float b = int(data[3 * i + 3 * nx * j + 2]) / 255.0;
-        return vec3(r, g, b);
+        texture_record t;
+        t.kind = TEX_IMAGE;
+        t.data = pixels;
+        t.nx = A;
+        t.ny = B;
+        id = scene_textures.add(t);
     }
-    unsigned char* data;
-    int nx, ny;
 };
-#endif
\ No newline at end of file
+#endif
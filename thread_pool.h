@@ -0,0 +1,156 @@
+// work-stealing thread pool
+#ifndef THREAD_POOL_H
+#define THREAD_POOL_H
+
+#include <thread>
+#include <mutex>
+#include <condition_variable>
+#include <atomic>
+#include <deque>
+#include <vector>
+#include <memory>
+#include <functional>
+
+// every worker owns a deque: it pops its own work from the back (LIFO, cache warm)
+// and steals from the front of the others when it runs dry.
+class thread_pool
+{
+public:
+    typedef std::function<void()> task;
+
+    thread_pool(int n = 0)
+    {
+        if(n <= 0) n = std::thread::hardware_concurrency();
+        if(n <= 0) n = 1;
+        for(int i = 0; i < n; ++i)
+            queues.emplace_back(new worker_queue);
+        for(int i = 0; i < n; ++i)
+            workers.emplace_back(&thread_pool::run, this, i);
+    }
+    ~thread_pool()
+    {
+        {
+            std::lock_guard<std::mutex> lock(wake_m);
+            stop = true;
+        }
+        wake_cv.notify_all();
+        for(auto& w : workers) w.join();
+    }
+    int size() const { return int(workers.size()); }
+
+    // tasks submitted from a worker go to its own deque, others are dealt round-robin
+    void submit(task t)
+    {
+        int id = worker_id();
+        if(id < 0 || owner() != this)
+            id = int(next_queue++ % queues.size());
+        ++pending;
+        {
+            std::lock_guard<std::mutex> lock(queues[id]->m);
+            queues[id]->tasks.push_back(std::move(t));
+        }
+        {
+            std::lock_guard<std::mutex> lock(wake_m);
+        }
+        wake_cv.notify_one();
+        done_cv.notify_all();
+    }
+
+    // block until every submitted task has finished, helping out meanwhile
+    void wait()
+    {
+        task t;
+        while(pending > 0)
+        {
+            if(steal(-1, t))
+            {
+                t();
+                finish();
+            }
+            else {
+                std::unique_lock<std::mutex> lock(wake_m);
+                done_cv.wait(lock, [this] { return pending == 0 || has_work(); });
+            }
+        }
+    }
+
+private:
+    struct worker_queue
+    {
+        std::mutex m;
+        std::deque<task> tasks;
+    };
+
+    static int& worker_id() { static thread_local int id = -1; return id; }
+    static thread_pool*& owner() { static thread_local thread_pool* p = nullptr; return p; }
+
+    bool pop_local(int id, task& t)
+    {
+        std::lock_guard<std::mutex> lock(queues[id]->m);
+        if(queues[id]->tasks.empty()) return false;
+        t = std::move(queues[id]->tasks.back());
+        queues[id]->tasks.pop_back();
+        return true;
+    }
+    bool steal(int id, task& t)
+    {
+        int n = int(queues.size());
+        for(int k = 1; k <= n; ++k)
+        {
+            int victim = (id + k + n) % n;
+            if(victim == id) continue;
+            std::lock_guard<std::mutex> lock(queues[victim]->m);
+            if(queues[victim]->tasks.empty()) continue;
+            t = std::move(queues[victim]->tasks.front());
+            queues[victim]->tasks.pop_front();
+            return true;
+        }
+        return false;
+    }
+    bool has_work()
+    {
+        for(auto& q : queues)
+        {
+            std::lock_guard<std::mutex> lock(q->m);
+            if(!q->tasks.empty()) return true;
+        }
+        return false;
+    }
+    void finish()
+    {
+        if(--pending == 0)
+        {
+            std::lock_guard<std::mutex> lock(wake_m);
+            done_cv.notify_all();
+        }
+    }
+    void run(int id)
+    {
+        worker_id() = id;
+        owner() = this;
+        task t;
+        for(;;)
+        {
+            if(pop_local(id, t) || steal(id, t))
+            {
+                t();
+                t = nullptr;
+                finish();
+                continue;
+            }
+            std::unique_lock<std::mutex> lock(wake_m);
+            wake_cv.wait(lock, [this] { return stop || has_work(); });
+            if(stop && !has_work()) return;
+        }
+    }
+
+    std::vector<std::unique_ptr<worker_queue>> queues;
+    std::vector<std::thread> workers;
+    std::mutex wake_m;
+    std::condition_variable wake_cv, done_cv;
+    std::atomic<int> pending{0};
+    std::atomic<unsigned> next_queue{0};
+    bool stop = false;
+};
+
+#endif
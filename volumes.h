@@ -3,47 +3,224 @@
 
 #include "hitable.h"
 #include "material.h"
+#include "arena.h"
+#include "density_grid.h"
 #include <float.h>
+#include <vector>
 
-class constant_medium : public hitable
+//media-----------------------------------------------------------------------------------------
+// hit() samples where a ray scatters inside the medium. shadow rays are not
+// blocked by media: direct_light weights them by the transmittance of the
+// scene's media instead, so media must be registered in a medium_list.
+class medium : public hitable
+{
+public:
+    virtual bool occluded(const ray& r, float t_min, float t_max) const { return false; }
+    // fraction of light passing along r over (t_min, t_max), or an unbiased
+    // estimate of it
+    virtual float transmittance(const ray& r, float t_min, float t_max, sampler& smp) const = 0;
+};
+
+class medium_list
+{
+public:
+    medium* add(medium* m)
+    {
+        media.push_back(m);
+        return m;
+    }
+    bool empty() const { return media.empty(); }
+    void clear() { media.clear(); }
+
+    float transmittance(const ray& r, float t_min, float t_max, sampler& smp) const
+    {
+        float tr = 1;
+        for(size_t k = 0; k < media.size() && tr > 0; ++k)
+            tr *= media[k]->transmittance(r, t_min, t_max, smp);
+        return tr;
+    }
+
+    std::vector<medium*> media;
+};
+
+class constant_medium : public medium
 {
 public:
     constant_medium(hitable* b, float d, texture* a) : boundary(b), density(d)
     {
-        phase_function = new isotropic(a);
+        phase_function = make<isotropic>(a);
     }
+    // the boundary is convex: one interval query gives the stretch of the
+    // ray inside it
     virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
     {
-        hit_record rec1, rec2;
-        if(boundary->hit(r, -FLT_MAX, FLT_MAX, rec1))
+        float t_enter, t_exit;
+        if(boundary->interval(r, t_enter, t_exit))
         {
-            if(boundary->hit(r, rec1.t + 0.0001, FLT_MAX, rec2))
+            t_enter = fmax(t_enter, t_min);
+            t_exit = fmin(t_exit, t_max);
+            if(t_enter >= t_exit) return false;
+            t_enter = fmax(0, t_enter);
+            float distance_inside_boundary = (t_exit - t_enter) * r.direction().length();
+            float hit_distance = -(1 / density) * log(media_sampler()->get_1d());
+            if(hit_distance < distance_inside_boundary)
             {
-                rec1.t = fmax(rec1.t, t_min);
-                rec2.t = fmin(rec2.t, t_max);
-                if(rec1.t >= rec2.t) return false;
-                rec1.t = fmax(0, rec1.t);
-                float distance_inside_boundary = (rec2.t - rec1.t) * r.direction().length();
-                float hit_distance = -(1 / density) * log(random());
-                if(hit_distance < distance_inside_boundary)
-                {
-                    rec.t = rec1.t + hit_distance / r.direction().length();
-                    rec.p = r.point_at_parameter(rec.t);
-                    rec.normal = vec3(1, 0, 0);
-                    rec.mat_ptr = phase_function;
-                    return true;
-                }
+                record_hit(rec, t_enter + hit_distance / r.direction().length(), this);
+                return true;
             }
         }
         return false;
     }
+    virtual float transmittance(const ray& r, float t_min, float t_max, sampler& smp) const
+    {
+        float t_enter, t_exit;
+        if(!boundary->interval(r, t_enter, t_exit)) return 1;
+        t_enter = fmax(t_enter, t_min);
+        t_exit = fmin(t_exit, t_max);
+        if(t_enter >= t_exit) return 1;
+        return exp(-density * (t_exit - t_enter) * r.direction().length());
+    }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        rec.p = r.point_at_parameter(rec.t);
+        rec.normal = vec3(1, 0, 0); // arbitrary
+        rec.mat_ptr = phase_function;
+    }
     virtual bool bounding_box(float t0, float t1, aabb& box) const
     {
         return boundary->bounding_box(t0, t1, box);
     }
+    virtual bool animated() const { return boundary->animated(); }
+    virtual void refit(float t0, float t1) { boundary->refit(t0, t1); }
     hitable* boundary;
     float density;
     material* phase_function;
 };
 
+//grid medium-----------------------------------------------------------------------------------
+// density_grid stretched over the box [p0, p1], its densities times scale.
+// tentative collisions are sampled against the majorant of each brick the
+// ray crosses (3d dda over the brick grid), so empty bricks are skipped and
+// thin ones take few steps. each is real with probability density / majorant:
+// hit() stops at the first real one (delta tracking), transmittance()
+// multiplies the chances of passing all of them (ratio tracking). tracking
+// takes a varying number of values, so they come from the sampler's pcg32
+// and leave its stratified dimensions to the scattering that follows.
+class grid_medium : public medium
+{
+public:
+    grid_medium(const density_grid* g, const vec3& p0, const vec3& p1, float scale, texture* a)
+        : grid(g), pmin(p0), pmax(p1), scale(scale)
+    {
+        phase_function = make<isotropic>(a);
+        for(int i = 0; i < 3; ++i)
+            to_voxel[i] = grid->n[i] / (pmax[i] - pmin[i]);
+    }
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+    {
+        sampler& smp = *media_sampler();
+        float t_hit = -1;
+        track(r, t_min, t_max, smp, [&](float t, float ratio) {
+            if(random(smp.rng) >= ratio) return true;
+            t_hit = t;
+            return false;
+        });
+        if(t_hit < 0) return false;
+        record_hit(rec, t_hit, this);
+        return true;
+    }
+    virtual float transmittance(const ray& r, float t_min, float t_max, sampler& smp) const
+    {
+        float tr = 1;
+        track(r, t_min, t_max, smp, [&](float t, float ratio) {
+            tr *= 1 - ratio;
+            // russian roulette once little is left, with weight 1 / q
+            if(tr < 0.1f)
+            {
+                if(random(smp.rng) >= 10 * tr)
+                {
+                    tr = 0;
+                    return false;
+                }
+                tr = 0.1f;
+            }
+            return true;
+        });
+        return tr;
+    }
+    virtual void shade(const ray& r, hit_record& rec) const
+    {
+        rec.p = r.point_at_parameter(rec.t);
+        rec.normal = vec3(1, 0, 0); // arbitrary
+        rec.mat_ptr = phase_function;
+    }
+    virtual bool bounding_box(float t0, float t1, aabb& box) const
+    {
+        box = aabb(pmin, pmax);
+        return true;
+    }
+
+    const density_grid* grid;
+    vec3 pmin, pmax;
+    float scale;
+    vec3 to_voxel; // voxels per unit along each axis
+    material* phase_function;
+
+private:
+    // calls collide(t, density / majorant) at every tentative collision in
+    // (t_min, t_max) until it returns false
+    template<class F>
+    void track(const ray& r, float t_min, float t_max, sampler& smp, F collide) const
+    {
+        // voxel space is a scaling of world space, so t is the same in both
+        vec3 o = (r.origin() - pmin) * to_voxel;
+        vec3 d = r.direction() * to_voxel;
+        for(int a = 0; a < 3; ++a)
+        {
+            float inv_d = 1.0f / d[a];
+            float t0 = -o[a] * inv_d, t1 = (grid->n[a] - o[a]) * inv_d;
+            t_min = std::max(t_min, std::min(t0, t1));
+            t_max = std::min(t_max, std::max(t0, t1));
+        }
+        if(t_min >= t_max) return;
+
+        // dda over the bricks, in brick units
+        const float bs = density_grid::brick_size;
+        float length = r.direction().length(); // world units per unit of t
+        int cell[3], step[3], last[3];
+        float t_next[3], t_delta[3];
+        vec3 p = o + t_min * d;
+        for(int a = 0; a < 3; ++a)
+        {
+            cell[a] = std::min(std::max(int(p[a] / bs), 0), grid->bn[a] - 1);
+            step[a] = d[a] > 0 ? 1 : -1;
+            last[a] = d[a] > 0 ? grid->bn[a] : -1;
+            t_delta[a] = d[a] != 0 ? bs / fabsf(d[a]) : FLT_MAX;
+            float boundary = (cell[a] + (d[a] > 0)) * bs;
+            t_next[a] = d[a] != 0 ? (boundary - o[a]) / d[a] : FLT_MAX;
+        }
+
+        float tau = -logf(1 - random(smp.rng)); // optical depth to the next tentative collision
+        float t = t_min;
+        while(t < t_max)
+        {
+            int a = t_next[0] < t_next[1] ? (t_next[0] < t_next[2] ? 0 : 2) : (t_next[1] < t_next[2] ? 1 : 2);
+            float t_cell = std::min(t_next[a], t_max);
+            float mu = scale * grid->majorant(cell[0], cell[1], cell[2]) * length;
+            while(mu > 0 && t + tau / mu < t_cell)
+            {
+                t += tau / mu;
+                float ratio = scale * grid->density(o + t * d) * length / mu;
+                if(!collide(t, ratio)) return;
+                tau = -logf(1 - random(smp.rng));
+            }
+            if(mu > 0) tau -= mu * (t_cell - t);
+            t = t_cell;
+            cell[a] += step[a];
+            if(cell[a] == last[a]) return;
+            t_next[a] += t_delta[a];
+        }
+    }
+};
+
 #endif
\ No newline at end of file
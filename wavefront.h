@@ -0,0 +1,124 @@
+// wavefront path tracing: whole batches of rays advance one stage at a time
+#ifndef WAVEFRONT_H
+#define WAVEFRONT_H
+
+#include "hitable.h"
+#include "material.h"
+#include "camera.h"
+#include "integrator.h"
+#include "render_settings.h"
+#include "framebuffer.h"
+#include "sampler.h"
+#include <vector>
+#include <algorithm>
+
+const int wavefront_size = 1 << 11; // paths per wave, small enough for the path state to stay in cache
+
+struct wave_path
+{
+    path_state state;
+    sampler smp;
+    int pixel; // index into the tile's accumulation buffer
+};
+
+// every stage runs over the whole wave before the next one starts:
+//   intersect : closest hit for every live path, misses finish with the background
+//   sort      : hits are bucketed by material kind, so each shading loop takes
+//               the same case of the material switch over and over
+//   shade     : path_bounce() on every hit of a bucket
+//   compact   : survivors are packed to the front to form the next wave
+// paths draw the same numbers as render_tile, so scenes without media render
+// identically to the recursive path.
+inline void render_tile_wavefront(const tile& t, const camera& cam, hitable* world, const render_settings& settings,
+                                  framebuffer& fb)
+{
+    const int ns = settings.ns;
+    int w = t.x1 - t.x0, h = t.y1 - t.y0;
+    std::vector<vec3> accum(size_t(w) * h, vec3(0));
+    int samples_per_wave = std::max(1, std::min(ns, wavefront_size / (w * h)));
+
+    std::vector<wave_path> paths, next;
+    std::vector<hit_record> hits;
+    std::vector<std::pair<material_kind, int>> order; // (material kind, path) of every hit
+    paths.reserve(size_t(w) * h * samples_per_wave);
+    path_counters& counters = thread_path_counters();
+
+    for(int s0 = 0; s0 < ns; s0 += samples_per_wave)
+    {
+        int s1 = std::min(ns, s0 + samples_per_wave);
+
+        // generate
+        paths.clear();
+        for(int j = t.y0; j < t.y1; ++j)
+            for(int i = t.x0; i < t.x1; ++i)
+            {
+                uint64_t pixel = uint64_t(j) * fb.nx + i;
+                if(!settings.sampled(pixel)) continue;
+                int first = settings.first(pixel);
+                for(int s = s0; s < s1; ++s)
+                {
+                    wave_path p;
+                    p.smp = sampler(settings.sampling);
+                    p.smp.start(pixel, first + s, settings.seed);
+                    float du, dv;
+                    p.smp.get_2d(du, dv);
+                    p.state.r = cam.get_ray(float(i + du) / float(fb.nx), float(j + dv) / float(fb.ny), p.smp);
+                    p.pixel = (j - t.y0) * w + (i - t.x0);
+                    paths.push_back(p);
+                }
+            }
+        counters.paths += paths.size();
+
+        while(!paths.empty())
+        {
+            counters.segments += paths.size();
+
+            // intersect
+            hits.resize(paths.size());
+            order.clear();
+            for(size_t k = 0; k < paths.size(); ++k)
+            {
+                wave_path& p = paths[k];
+                media_sampler() = &p.smp;
+                if(world->hit(p.state.r, 0.001, FLT_MAX, hits[k]))
+                {
+                    finish_hit(p.state.r, hits[k]);
+                    order.push_back(std::make_pair(hits[k].mat_ptr->record().kind, int(k)));
+                }
+                else {
+                    p.state.radiance += p.state.throughput * background(p.state.r);
+                    accum[p.pixel] += p.state.radiance;
+                }
+            }
+
+            // sort
+            std::sort(order.begin(), order.end());
+
+            // shade
+            size_t live = 0;
+            for(const auto& o : order)
+            {
+                wave_path& p = paths[o.second];
+                media_sampler() = &p.smp;
+                if(path_bounce(p.state, hits[o.second], world, settings.path, p.smp))
+                    order[live++].second = o.second;
+                else
+                    accum[p.pixel] += p.state.radiance;
+            }
+
+            // compact, keeping the kind order for the next intersection pass
+            next.clear();
+            for(size_t k = 0; k < live; ++k)
+                next.push_back(paths[order[k].second]);
+            paths.swap(next);
+        }
+    }
+
+    for(int j = t.y0; j < t.y1; ++j)
+        for(int i = t.x0; i < t.x1; ++i)
+            if(settings.sampled(size_t(j) * fb.nx + i))
+                fb.at(i, j) = accum[(j - t.y0) * w + (i - t.x0)] / float(ns);
+    media_sampler() = &thread_sampler();
+}
+
+#endif
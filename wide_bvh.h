@@ -0,0 +1,386 @@
+// 4/8-wide bvh, all child boxes of a node tested against the ray at once
+#ifndef WIDE_BVH_H
+#define WIDE_BVH_H
+
+#include "hitable.h"
+#include "bvh.h"
+#include <stdint.h>
+#if defined(__SSE2__) || defined(_M_X64)
+#include <immintrin.h>
+#endif
+
+// child bounds in SoA layout : bmin[axis][child]. an interior child holds its
+// node index in child[], a leaf child holds ~first primitive and count > 0.
+// unused slots have inverted bounds and can never be hit.
+template <int W>
+struct alignas(32) wide_bvh_node
+{
+    float bmin[3][W], bmax[3][W];
+    int32_t child[W];
+    int32_t count[W];
+};
+
+// ray data shared by every node test of one traversal
+struct wide_ray
+{
+    float o[3], inv_d[3];
+    int neg[3]; // sign mask, selects near/far plane per axis
+};
+
+// writes the entry distance of every child and returns the hit mask
+template <int W>
+inline int wide_slab_hit(const wide_bvh_node<W>& n, const wide_ray& wr, float t_min, float t_max, float* t_near)
+{
+    int mask = 0;
+    for(int k = 0; k < W; ++k)
+    {
+        float t0 = t_min, t1 = t_max;
+        for(int a = 0; a < 3; ++a)
+        {
+            float tn = ((wr.neg[a] ? n.bmax[a][k] : n.bmin[a][k]) - wr.o[a]) * wr.inv_d[a];
+            float tf = ((wr.neg[a] ? n.bmin[a][k] : n.bmax[a][k]) - wr.o[a]) * wr.inv_d[a];
+            t0 = tn > t0 ? tn : t0;
+            t1 = tf < t1 ? tf : t1;
+        }
+        t_near[k] = t0;
+        if(t0 <= t1) mask |= 1 << k;
+    }
+    return mask;
+}
+
+#if defined(__SSE2__) || defined(_M_X64)
+// the computed distance goes first into max/min so a NaN (0 * inf) keeps the old bound
+template <>
+inline int wide_slab_hit<4>(const wide_bvh_node<4>& n, const wide_ray& wr, float t_min, float t_max, float* t_near)
+{
+    __m128 t0 = _mm_set1_ps(t_min);
+    __m128 t1 = _mm_set1_ps(t_max);
+    for(int a = 0; a < 3; ++a)
+    {
+        __m128 o = _mm_set1_ps(wr.o[a]);
+        __m128 inv = _mm_set1_ps(wr.inv_d[a]);
+        __m128 lo = _mm_load_ps(wr.neg[a] ? n.bmax[a] : n.bmin[a]);
+        __m128 hi = _mm_load_ps(wr.neg[a] ? n.bmin[a] : n.bmax[a]);
+        t0 = _mm_max_ps(_mm_mul_ps(_mm_sub_ps(lo, o), inv), t0);
+        t1 = _mm_min_ps(_mm_mul_ps(_mm_sub_ps(hi, o), inv), t1);
+    }
+    _mm_storeu_ps(t_near, t0);
+    return _mm_movemask_ps(_mm_cmple_ps(t0, t1));
+}
+#endif
+
+#ifdef __AVX__
+template <>
+inline int wide_slab_hit<8>(const wide_bvh_node<8>& n, const wide_ray& wr, float t_min, float t_max, float* t_near)
+{
+    __m256 t0 = _mm256_set1_ps(t_min);
+    __m256 t1 = _mm256_set1_ps(t_max);
+    for(int a = 0; a < 3; ++a)
+    {
+        __m256 o = _mm256_set1_ps(wr.o[a]);
+        __m256 inv = _mm256_set1_ps(wr.inv_d[a]);
+        __m256 lo = _mm256_load_ps(wr.neg[a] ? n.bmax[a] : n.bmin[a]);
+        __m256 hi = _mm256_load_ps(wr.neg[a] ? n.bmin[a] : n.bmax[a]);
+        t0 = _mm256_max_ps(_mm256_mul_ps(_mm256_sub_ps(lo, o), inv), t0);
+        t1 = _mm256_min_ps(_mm256_mul_ps(_mm256_sub_ps(hi, o), inv), t1);
+    }
+    _mm256_storeu_ps(t_near, t0);
+    return _mm256_movemask_ps(_mm256_cmp_ps(t0, t1, _CMP_LE_OQ));
+}
+#endif
+
+template <int W>
+class wide_bvh : public hitable
+{
+public:
+    wide_bvh(hitable** l, int n, float time0, float time1);
+    virtual bool hit(const ray& r, float t_min, float t_max, hit_record& rec) const;
+    virtual bool occluded(const ray& r, float t_min, float t_max) const;
+    virtual bool bounding_box(float t0, float t1, aabb& b) const
+    {
+        b = box;
+        return true;
+    }
+    virtual bool animated() const { return !dynamic.empty(); }
+    virtual void refit(float t0, float t1);
+
+    std::vector<wide_bvh_node<W>> nodes;
+    std::vector<hitable*> prims; // in leaf order
+    aabb box;
+    std::vector<uint8_t> dynamic; // per node, something below is animated. empty if nothing is
+    float built_cost = 0;         // sah cost when built, the refit baseline
+private:
+    int build(const bvh_builder& b, const bvh_build_node& node);
+    void mark_dynamic();
+    float sah_cost() const;
+};
+
+template <int W>
+struct arena_category_of<wide_bvh<W>>
+{
+    static const arena_category value = ARENA_ACCEL;
+};
+
+template <int W>
+inline wide_bvh<W>::wide_bvh(hitable** l, int n, float time0, float time1)
+{
+    bvh_builder b(l, n, time0, time1);
+    prims.resize(n);
+    for(int i = 0; i < n; ++i)
+        prims[i] = b.prims[i].ptr;
+    box = b.root().bounds;
+    if(b.root().leaf())
+    {
+        // a single leaf still needs one node above it
+        nodes.emplace_back();
+        wide_bvh_node<W>& node = nodes.back();
+        for(int k = 0; k < W; ++k)
+            for(int a = 0; a < 3; ++a)
+            {
+                node.bmin[a][k] = k ? FLT_MAX : box.min()[a];
+                node.bmax[a][k] = k ? -FLT_MAX : box.max()[a];
+            }
+        for(int k = 0; k < W; ++k)
+            node.child[k] = node.count[k] = 0;
+        node.child[0] = ~0;
+        node.count[0] = n;
+    }
+    else
+        build(b, b.root());
+    mark_dynamic();
+}
+
+template <int W>
+inline void wide_bvh<W>::mark_dynamic()
+{
+    std::vector<uint8_t> d(nodes.size(), 0);
+    bool any = false;
+    for(int i = int(nodes.size()) - 1; i >= 0; --i)
+        for(int k = 0; k < W; ++k)
+        {
+            const wide_bvh_node<W>& node = nodes[i];
+            if(node.count[k] > 0)
+                for(int j = 0; j < node.count[k]; ++j)
+                    d[i] |= prims[~node.child[k] + j]->animated();
+            else if(node.child[k] > 0)
+                d[i] |= d[node.child[k]];
+        }
+    for(uint8_t x : d) any = any || x;
+    if(!any) return;
+    dynamic.swap(d);
+    built_cost = sah_cost();
+}
+
+// same measure as bvh_stats: traversal cost per node reached, intersection
+// cost per primitive, weighted by area relative to the root
+template <int W>
+inline float wide_bvh<W>::sah_cost() const
+{
+    float root_area = box.area();
+    float cost = bvh_traversal_cost;
+    for(const wide_bvh_node<W>& node : nodes)
+        for(int k = 0; k < W; ++k)
+        {
+            if(node.count[k] == 0 && node.child[k] == 0) continue;
+            aabb b(vec3(node.bmin[0][k], node.bmin[1][k], node.bmin[2][k]),
+                   vec3(node.bmax[0][k], node.bmax[1][k], node.bmax[2][k]));
+            float p = root_area > 0 ? b.area() / root_area : 1;
+            cost += p * (node.count[k] > 0 ? bvh_intersect_cost * node.count[k] : bvh_traversal_cost);
+        }
+    return cost;
+}
+
+// children come after their parent, so one backwards pass refits bottom up
+template <int W>
+inline void wide_bvh<W>::refit(float t0, float t1)
+{
+    if(dynamic.empty()) return;
+    for(int i = int(nodes.size()) - 1; i >= 0; --i)
+    {
+        if(!dynamic[i]) continue;
+        wide_bvh_node<W>& node = nodes[i];
+        for(int k = 0; k < W; ++k)
+        {
+            aabb b = empty_box();
+            if(node.count[k] > 0)
+                for(int j = 0; j < node.count[k]; ++j)
+                {
+                    hitable* h = prims[~node.child[k] + j];
+                    aabb hb;
+                    if(h->animated()) h->refit(t0, t1);
+                    h->bounding_box(t0, t1, hb);
+                    b = surrounding_box(b, hb);
+                }
+            else if(node.child[k] > 0) {
+                const wide_bvh_node<W>& c = nodes[node.child[k]];
+                for(int j = 0; j < W; ++j)
+                    b = surrounding_box(b, aabb(vec3(c.bmin[0][j], c.bmin[1][j], c.bmin[2][j]),
+                                                vec3(c.bmax[0][j], c.bmax[1][j], c.bmax[2][j])));
+            }
+            else continue;
+            for(int a = 0; a < 3; ++a)
+            {
+                node.bmin[a][k] = b.min()[a];
+                node.bmax[a][k] = b.max()[a];
+            }
+        }
+    }
+    box = empty_box();
+    for(int k = 0; k < W; ++k)
+        if(nodes[0].count[k] > 0 || nodes[0].child[k] > 0)
+            box = surrounding_box(box, aabb(vec3(nodes[0].bmin[0][k], nodes[0].bmin[1][k], nodes[0].bmin[2][k]),
+                                            vec3(nodes[0].bmax[0][k], nodes[0].bmax[1][k], nodes[0].bmax[2][k])));
+    if(sah_cost() <= built_cost * bvh_refit_threshold) return;
+    std::vector<hitable*> l = prims;
+    ++bvh_rebuilds;
+    *this = wide_bvh(l.data(), int(l.size()), t0, t1);
+}
+
+// collapses the binary sah tree: the child with the largest surface is opened
+// until the node has W children or only leaves are left
+template <int W>
+inline int wide_bvh<W>::build(const bvh_builder& b, const bvh_build_node& node)
+{
+    const bvh_build_node* children[W];
+    int count = 1;
+    children[0] = &node;
+    while(count < W)
+    {
+        int best = -1;
+        for(int k = 0; k < count; ++k)
+            if(!children[k]->leaf() && (best < 0 || children[k]->bounds.area() > children[best]->bounds.area()))
+                best = k;
+        if(best < 0) break;
+        const bvh_build_node* c = children[best];
+        children[best] = &b.nodes[c->child[0]];
+        children[count++] = &b.nodes[c->child[1]];
+    }
+
+    int index = int(nodes.size());
+    nodes.emplace_back();
+    for(int k = 0; k < W; ++k)
+    {
+        bool used = k < count;
+        for(int a = 0; a < 3; ++a)
+        {
+            nodes[index].bmin[a][k] = used ? children[k]->bounds.min()[a] : FLT_MAX;
+            nodes[index].bmax[a][k] = used ? children[k]->bounds.max()[a] : -FLT_MAX;
+        }
+        nodes[index].child[k] = 0;
+        nodes[index].count[k] = 0;
+    }
+    for(int k = 0; k < count; ++k)
+    {
+        if(children[k]->leaf())
+        {
+            nodes[index].child[k] = ~children[k]->begin;
+            nodes[index].count[k] = children[k]->n;
+        }
+        else {
+            int c = build(b, *children[k]);
+            nodes[index].child[k] = c;
+        }
+    }
+    return index;
+}
+
+// hit children are pushed far to near, so the nearest one is popped first.
+// entries whose entry distance is past the current closest hit are dropped.
+template <int W>
+inline bool wide_bvh<W>::hit(const ray& r, float t_min, float t_max, hit_record& rec) const
+{
+    wide_ray wr;
+    for(int a = 0; a < 3; ++a)
+    {
+        wr.o[a] = r.origin()[a];
+        wr.inv_d[a] = 1.0f / r.direction()[a];
+        wr.neg[a] = wr.inv_d[a] < 0;
+    }
+    struct entry { int child, count; float t; };
+    entry stack[64 * W];
+    int sp = 0;
+    stack[sp++] = {0, 0, t_min};
+    bool hit_anything = false;
+    int visited = 0;
+    while(sp > 0)
+    {
+        entry e = stack[--sp];
+        if(e.t > t_max) continue;
+        if(e.count > 0)
+        {
+            for(int i = 0; i < e.count; ++i)
+                if(prims[~e.child + i]->hit(r, t_min, t_max, rec))
+                {
+                    hit_anything = true;
+                    t_max = rec.t;
+                }
+            continue;
+        }
+        const wide_bvh_node<W>& node = nodes[e.child];
+        ++visited;
+        float t_near[W];
+        int mask = wide_slab_hit<W>(node, wr, t_min, t_max, t_near);
+        // insertion sort of the hit children by descending entry distance
+        int first = sp;
+        for(int k = 0; k < W; ++k)
+        {
+            if(!(mask & (1 << k))) continue;
+            entry c = {node.child[k], node.count[k], t_near[k]};
+            int j = sp++;
+            while(j > first && stack[j - 1].t < c.t)
+            {
+                stack[j] = stack[j - 1];
+                --j;
+            }
+            stack[j] = c;
+        }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return hit_anything;
+}
+
+// any hit: children go on the stack unsorted, the first primitive hit ends the walk
+template <int W>
+inline bool wide_bvh<W>::occluded(const ray& r, float t_min, float t_max) const
+{
+    wide_ray wr;
+    for(int a = 0; a < 3; ++a)
+    {
+        wr.o[a] = r.origin()[a];
+        wr.inv_d[a] = 1.0f / r.direction()[a];
+        wr.neg[a] = wr.inv_d[a] < 0;
+    }
+    int stack[64 * W][2]; // child, count
+    int sp = 0;
+    stack[sp][0] = 0;
+    stack[sp++][1] = 0;
+    bool blocked = false;
+    int visited = 0;
+    while(sp > 0 && !blocked)
+    {
+        --sp;
+        int child = stack[sp][0], count = stack[sp][1];
+        if(count > 0)
+        {
+            for(int i = 0; i < count && !blocked; ++i)
+                blocked = prims[~child + i]->occluded(r, t_min, t_max);
+            continue;
+        }
+        const wide_bvh_node<W>& node = nodes[child];
+        ++visited;
+        float t_near[W];
+        int mask = wide_slab_hit<W>(node, wr, t_min, t_max, t_near);
+        for(int k = 0; k < W; ++k)
+            if(mask & (1 << k))
+            {
+                stack[sp][0] = node.child[k];
+                stack[sp++][1] = node.count[k];
+            }
+    }
+    thread_counters().nodes += visited;
+    ++thread_counters().traversals;
+    return blocked;
+}
+
+#endif